@@ -0,0 +1,280 @@
+/*
+ * This file is part of the sigrok project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "sigrok-cli.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define HAVE_F16C_KERNEL 1
+#endif
+
+/*
+ * Analog samples as raw binary, one value per enabled probe for every
+ * sample, in the machine's byte order. Values can be written as they come
+ * (32-bit floats), or to take up half the space, as 16-bit integers after
+ * multiplying by a scale factor, or as 16-bit half-precision floats:
+ *
+ *   -O analog-bin:type=int16:scale=1000
+ *
+ * writes millivolts for a device which sends volts.
+ */
+
+enum {
+	ANALOG_BIN_FLOAT,
+	ANALOG_BIN_INT16,
+	ANALOG_BIN_HALF,
+};
+
+typedef void (*convert_func)(const float *in, void *out, uint64_t n,
+		float scale);
+
+struct analog_bin {
+	int type;
+	float scale;
+	convert_func convert;
+};
+
+static void convert_float(const float *in, void *out, uint64_t n,
+		float scale)
+{
+	(void)scale;
+
+	memcpy(out, in, n * sizeof(float));
+}
+
+/* Rounded to the nearest, and clamped; NaN becomes 0. */
+static void convert_int16(const float *in, void *out, uint64_t n,
+		float scale)
+{
+	int16_t *o;
+	uint64_t i;
+	float v;
+
+	o = out;
+	for (i = 0; i < n; i++) {
+		v = in[i] * scale;
+		v = v == v ? v : 0;
+		v = v > 32767.0f ? 32767.0f : v;
+		v = v < -32768.0f ? -32768.0f : v;
+		o[i] = (int16_t)(v + (v < 0 ? -0.5f : 0.5f));
+	}
+}
+
+static inline uint32_t float_bits(float f)
+{
+	uint32_t u;
+
+	memcpy(&u, &f, sizeof(u));
+
+	return u;
+}
+
+static inline float bits_float(uint32_t u)
+{
+	float f;
+
+	memcpy(&f, &u, sizeof(f));
+
+	return f;
+}
+
+/*
+ * IEEE 754 binary16, rounded to the nearest even: out of range values
+ * become infinity, and those too small for a normal half have their
+ * mantissa shifted into place by a float addition.
+ */
+static inline uint16_t float_to_half(float f)
+{
+	uint32_t u, sign, odd;
+	uint16_t h;
+
+	u = float_bits(f);
+	sign = u & 0x80000000;
+	u ^= sign;
+	if (u >= (uint32_t)(127 + 16) << 23) {
+		/* Infinity, NaN, or too big. */
+		h = u > (uint32_t)255 << 23 ? 0x7e00 : 0x7c00;
+	} else if (u < (uint32_t)113 << 23) {
+		/* Subnormal, or zero. */
+		h = float_bits(bits_float(u) + bits_float(126 << 23))
+				- (126 << 23);
+	} else {
+		odd = (u >> 13) & 1;
+		u += ((uint32_t)(15 - 127) << 23) + 0xfff + odd;
+		h = u >> 13;
+	}
+
+	return h | (sign >> 16);
+}
+
+static void convert_half(const float *in, void *out, uint64_t n,
+		float scale)
+{
+	uint16_t *o;
+	uint64_t i;
+
+	(void)scale;
+
+	o = out;
+	for (i = 0; i < n; i++)
+		o[i] = float_to_half(in[i]);
+}
+
+#ifdef HAVE_F16C_KERNEL
+__attribute__((target("avx,f16c")))
+static void convert_half_f16c(const float *in, void *out, uint64_t n,
+		float scale)
+{
+	uint16_t *o;
+	uint64_t i;
+
+	(void)scale;
+
+	o = out;
+	for (i = 0; i + 8 <= n; i += 8)
+		_mm_storeu_si128((__m128i *)(o + i), _mm256_cvtps_ph(
+				_mm256_loadu_ps(in + i),
+				_MM_FROUND_TO_NEAREST_INT));
+	for (; i < n; i++)
+		o[i] = float_to_half(in[i]);
+}
+
+static gboolean have_f16c(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return FALSE;
+
+	/* The instructions need the OS to save the AVX registers. */
+	return (ecx & bit_F16C) && __builtin_cpu_supports("avx");
+}
+#endif
+
+static int init(struct sr_output *o)
+{
+	struct analog_bin *ab;
+	GHashTable *args;
+	char *val;
+
+	if (!(ab = g_try_malloc0(sizeof(struct analog_bin)))) {
+		g_critical("Analog output malloc failed.");
+		return SR_ERR_MALLOC;
+	}
+	ab->type = ANALOG_BIN_FLOAT;
+	ab->scale = 1.0;
+
+	args = parse_generic_arg(o->param, FALSE);
+	if (args && (val = g_hash_table_lookup(args, "type"))) {
+		if (!strcmp(val, "float"))
+			ab->type = ANALOG_BIN_FLOAT;
+		else if (!strcmp(val, "int16"))
+			ab->type = ANALOG_BIN_INT16;
+		else if (!strcmp(val, "half"))
+			ab->type = ANALOG_BIN_HALF;
+		else {
+			g_critical("Invalid analog output type '%s'.", val);
+			goto err;
+		}
+	}
+	if (args && (val = g_hash_table_lookup(args, "scale"))) {
+		ab->scale = g_ascii_strtod(val, NULL);
+		if (ab->scale == 0 || ab->type != ANALOG_BIN_INT16) {
+			g_critical("Invalid analog output scale '%s', it "
+					"needs type=int16.", val);
+			goto err;
+		}
+	}
+	if (args)
+		g_hash_table_destroy(args);
+
+	switch (ab->type) {
+	case ANALOG_BIN_INT16:
+		ab->convert = convert_int16;
+		break;
+	case ANALOG_BIN_HALF:
+		ab->convert = convert_half;
+#ifdef HAVE_F16C_KERNEL
+		if (have_f16c())
+			ab->convert = convert_half_f16c;
+#endif
+		break;
+	default:
+		ab->convert = convert_float;
+	}
+	o->internal = ab;
+
+	return SR_OK;
+
+err:
+	if (args)
+		g_hash_table_destroy(args);
+	g_free(ab);
+	return SR_ERR_ARG;
+}
+
+static int data(struct sr_output *o, const uint8_t *data_in,
+		uint64_t length_in, uint8_t **data_out, uint64_t *length_out)
+{
+	struct analog_bin *ab;
+	uint64_t n, len;
+	uint8_t *buf;
+
+	ab = o->internal;
+	*data_out = NULL;
+	*length_out = 0;
+	if (!(n = length_in / sizeof(float)))
+		return SR_OK;
+
+	len = n * (ab->type == ANALOG_BIN_FLOAT ? sizeof(float)
+			: sizeof(uint16_t));
+	if (!(buf = g_try_malloc(len))) {
+		g_critical("Analog output malloc failed.");
+		return SR_ERR_MALLOC;
+	}
+	ab->convert((const float *)data_in, buf, n, ab->scale);
+	*data_out = buf;
+	*length_out = len;
+
+	return SR_OK;
+}
+
+static int cleanup(struct sr_output *o)
+{
+	g_free(o->internal);
+	o->internal = NULL;
+
+	return SR_OK;
+}
+
+struct sr_output_format output_analog_bin = {
+	.id = "analog-bin",
+	.description = "Raw analog samples, as float, int16 or half",
+	.df_type = SR_DF_ANALOG,
+	.init = init,
+	.data = data,
+	.cleanup = cleanup,
+};
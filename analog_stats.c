@@ -0,0 +1,255 @@
+/*
+ * This file is part of the sigrok project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "sigrok-cli.h"
+
+/*
+ * With --analog-stats, analog samples aren't output at all. Instead, every
+ * window of so many samples becomes one line, with the lowest, highest,
+ * mean and RMS value of each probe, and the number of values that went
+ * into them. Values which aren't numbers, as some multimeters send on
+ * overload, are left out. Windows carry over from one packet to the next.
+ */
+
+/* Independent accumulators per probe, so the loops vectorize. */
+#define LANES 4
+
+struct probe_acc {
+	float min;
+	float max;
+	double sum;
+	double sumsq;
+	uint64_t count;
+};
+
+struct analog_stats {
+	uint64_t window;
+	int num_probes;
+	char **probe_names;
+	/* First sample of the current window. */
+	uint64_t start;
+	/* How far into the current window the samples so far got. */
+	uint64_t pos;
+	struct probe_acc *acc;
+};
+
+static void acc_reset(struct analog_stats *as)
+{
+	int j;
+
+	for (j = 0; j < as->num_probes; j++) {
+		as->acc[j].min = INFINITY;
+		as->acc[j].max = -INFINITY;
+		as->acc[j].sum = 0;
+		as->acc[j].sumsq = 0;
+		as->acc[j].count = 0;
+	}
+}
+
+/**
+ * Set up statistics for analog samples.
+ *
+ * @param window Number of samples each line covers.
+ * @param probe_names Names of the probes, in the order their values come
+ *                    in. NULL-terminated.
+ *
+ * @return The statistics, or NULL upon errors.
+ */
+struct analog_stats *analog_stats_new(uint64_t window, char **probe_names)
+{
+	struct analog_stats *as;
+
+	if (!(as = g_try_malloc0(sizeof(struct analog_stats)))) {
+		g_critical("Analog statistics malloc failed.");
+		return NULL;
+	}
+	as->window = window;
+	as->num_probes = g_strv_length(probe_names);
+	as->probe_names = g_strdupv(probe_names);
+	if (!(as->acc = g_try_malloc(MAX(as->num_probes, 1)
+			* sizeof(struct probe_acc)))) {
+		g_critical("Analog statistics malloc failed.");
+		analog_stats_destroy(as);
+		return NULL;
+	}
+	acc_reset(as);
+
+	return as;
+}
+
+/*
+ * Add n samples of one probe to its accumulator. The values are stride
+ * floats apart; for a single probe, that's all of them in a row. NaN fails
+ * every comparison, so it never becomes the minimum or maximum, and adds
+ * nothing to the sums.
+ */
+static void reduce(struct probe_acc *acc, const float *p, uint64_t n,
+		int stride)
+{
+	float min[LANES], max[LANES], v;
+	double sum[LANES], sumsq[LANES];
+	uint64_t count[LANES], i;
+	int k, valid;
+
+	for (k = 0; k < LANES; k++) {
+		min[k] = acc->min;
+		max[k] = acc->max;
+		sum[k] = sumsq[k] = 0;
+		count[k] = 0;
+	}
+	for (i = 0; i + LANES <= n; i += LANES) {
+		for (k = 0; k < LANES; k++) {
+			v = p[(i + k) * stride];
+			valid = v == v;
+			min[k] = v < min[k] ? v : min[k];
+			max[k] = v > max[k] ? v : max[k];
+			v = valid ? v : 0;
+			sum[k] += v;
+			sumsq[k] += (double)v * v;
+			count[k] += valid;
+		}
+	}
+	for (k = 0; i < n; i++, k++) {
+		v = p[i * stride];
+		valid = v == v;
+		min[k] = v < min[k] ? v : min[k];
+		max[k] = v > max[k] ? v : max[k];
+		v = valid ? v : 0;
+		sum[k] += v;
+		sumsq[k] += (double)v * v;
+		count[k] += valid;
+	}
+
+	for (k = 0; k < LANES; k++) {
+		acc->min = min[k] < acc->min ? min[k] : acc->min;
+		acc->max = max[k] > acc->max ? max[k] : acc->max;
+		acc->sum += sum[k];
+		acc->sumsq += sumsq[k];
+		acc->count += count[k];
+	}
+}
+
+/* Write out the current window as one line, and start the next one. */
+static void window_end(struct analog_stats *as, GString *s)
+{
+	struct probe_acc *acc;
+	int j;
+
+	g_string_append_printf(s, "%" PRIu64, as->start);
+	for (j = 0; j < as->num_probes; j++) {
+		acc = &as->acc[j];
+		if (acc->count)
+			g_string_append_printf(s, " %s=%g/%g/%g/%g/%" PRIu64,
+					as->probe_names[j], acc->min, acc->max,
+					acc->sum / acc->count,
+					sqrt(acc->sumsq / acc->count),
+					acc->count);
+		else
+			g_string_append_printf(s, " %s=-/-/-/-/0",
+					as->probe_names[j]);
+	}
+	g_string_append_c(s, '\n');
+
+	as->start += as->pos;
+	as->pos = 0;
+	acc_reset(as);
+}
+
+static uint64_t stats_out(GString *s, uint8_t **out)
+{
+	uint64_t len;
+
+	if (!(len = s->len)) {
+		g_string_free(s, TRUE);
+		*out = NULL;
+		return 0;
+	}
+	*out = (uint8_t *)g_string_free(s, FALSE);
+
+	return len;
+}
+
+/**
+ * Add analog samples to the statistics.
+ *
+ * @param as The statistics.
+ * @param data The samples, one float per probe each.
+ * @param num_samples Number of samples.
+ * @param out Set to a line of text for every window completed, to be freed
+ *            with g_free(), or NULL if there are none.
+ *
+ * @return Length of the text, in bytes.
+ */
+uint64_t analog_stats_run(struct analog_stats *as, const float *data,
+		uint64_t num_samples, uint8_t **out)
+{
+	GString *s;
+	uint64_t i, n;
+	int j;
+
+	s = g_string_sized_new(128);
+	for (i = 0; i < num_samples; i += n) {
+		n = MIN(as->window - as->pos, num_samples - i);
+		for (j = 0; j < as->num_probes; j++)
+			reduce(&as->acc[j], data + i * as->num_probes + j, n,
+					as->num_probes);
+		if ((as->pos += n) == as->window)
+			window_end(as, s);
+	}
+
+	return stats_out(s, out);
+}
+
+/**
+ * Get the line for the last, unfinished window, so the end of a capture
+ * isn't lost.
+ *
+ * @param as The statistics.
+ * @param out Set to the line, to be freed with g_free(), or NULL if
+ *            there's none.
+ *
+ * @return Length of the line, in bytes.
+ */
+uint64_t analog_stats_flush(struct analog_stats *as, uint8_t **out)
+{
+	GString *s;
+
+	s = g_string_sized_new(128);
+	if (as->pos)
+		window_end(as, s);
+
+	return stats_out(s, out);
+}
+
+void analog_stats_destroy(struct analog_stats *as)
+{
+	if (!as)
+		return;
+
+	g_strfreev(as->probe_names);
+	g_free(as->acc);
+	g_free(as);
+}
@@ -0,0 +1,186 @@
+/*
+ * This file is part of the sigrok project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sigrokdecode.h> /* First, so we avoid a _POSIX_C_SOURCE warning. */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "sigrok-cli.h"
+
+/*
+ * Protocol decoder annotations are formatted into records here, to be
+ * buffered and written out by the caller. Besides the plain text lines
+ * there's one JSON object per line, and a compact binary record which is
+ * cheap to produce and to parse:
+ *
+ *   u32 length of the rest of the record
+ *   u64 start sample
+ *   u64 end sample
+ *   u8  annotation class
+ *   u8  length of the protocol ID, followed by the ID
+ *   u8  number of strings, each a u16 length followed by the string
+ *
+ * All integers are little-endian, strings are not NUL-terminated.
+ */
+
+static void put8(GString *s, uint8_t v)
+{
+	g_string_append_c(s, v);
+}
+
+static void put16(GString *s, uint16_t v)
+{
+	put8(s, v & 0xff);
+	put8(s, v >> 8);
+}
+
+static void put32(GString *s, uint32_t v)
+{
+	put16(s, v & 0xffff);
+	put16(s, v >> 16);
+}
+
+static void put64(GString *s, uint64_t v)
+{
+	put32(s, v & 0xffffffff);
+	put32(s, v >> 32);
+}
+
+static void json_string(GString *s, const char *str)
+{
+	const unsigned char *p;
+
+	g_string_append_c(s, '"');
+	for (p = (const unsigned char *)str; *p; p++) {
+		if (*p == '"' || *p == '\\') {
+			g_string_append_c(s, '\\');
+			g_string_append_c(s, *p);
+		} else if (*p == '\n') {
+			g_string_append(s, "\\n");
+		} else if (*p < 0x20) {
+			g_string_append_printf(s, "\\u%04x", *p);
+		} else {
+			g_string_append_c(s, *p);
+		}
+	}
+	g_string_append_c(s, '"');
+}
+
+static const char *ann_class_name(const struct srd_proto_data *pdata)
+{
+	char **ann_descr;
+
+	ann_descr = g_slist_nth_data(pdata->pdo->di->decoder->annotations,
+			pdata->ann_format);
+
+	return ann_descr ? ann_descr[0] : "";
+}
+
+/**
+ * Parse an annotation format name.
+ *
+ * @param str The format: "text", "json" or "binary".
+ * @param format Set to one of the ANN_FORMAT_* formats.
+ *
+ * @return SR_OK upon success, SR_ERR if the format is unknown.
+ */
+int ann_format_parse(const char *str, int *format)
+{
+	if (!strcmp(str, "text"))
+		*format = ANN_FORMAT_TEXT;
+	else if (!strcmp(str, "json"))
+		*format = ANN_FORMAT_JSON;
+	else if (!strcmp(str, "binary"))
+		*format = ANN_FORMAT_BINARY;
+	else {
+		g_critical("Invalid annotation format '%s'.", str);
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Append one annotation record to a buffer.
+ *
+ * @param s The buffer.
+ * @param format One of the ANN_FORMAT_* formats.
+ * @param pdata The annotation, as passed to the decoder output callback.
+ * @param samples If TRUE, the text format includes the sample range.
+ *                The other formats always do.
+ */
+void ann_format_record(GString *s, int format,
+		const struct srd_proto_data *pdata, gboolean samples)
+{
+	char **annotations;
+	gsize start, len;
+	int num, i;
+
+	annotations = pdata->data;
+	switch (format) {
+	case ANN_FORMAT_JSON:
+		g_string_append_printf(s, "{\"start\":%" PRIu64 ",\"end\":%"
+				PRIu64 ",\"pd\":", pdata->start_sample,
+				pdata->end_sample);
+		json_string(s, pdata->pdo->proto_id);
+		g_string_append(s, ",\"class\":");
+		json_string(s, ann_class_name(pdata));
+		g_string_append(s, ",\"data\":[");
+		for (i = 0; annotations[i]; i++) {
+			if (i)
+				g_string_append_c(s, ',');
+			json_string(s, annotations[i]);
+		}
+		g_string_append(s, "]}\n");
+		break;
+	case ANN_FORMAT_BINARY:
+		start = s->len;
+		put32(s, 0);
+		put64(s, pdata->start_sample);
+		put64(s, pdata->end_sample);
+		put8(s, pdata->ann_format);
+		len = MIN(strlen(pdata->pdo->proto_id), G_MAXUINT8);
+		put8(s, len);
+		g_string_append_len(s, pdata->pdo->proto_id, len);
+		for (num = 0; annotations[num] && num < G_MAXUINT8; num++)
+			;
+		put8(s, num);
+		for (i = 0; i < num; i++) {
+			len = MIN(strlen(annotations[i]), G_MAXUINT16);
+			put16(s, len);
+			g_string_append_len(s, annotations[i], len);
+		}
+		/* Now that the length is known, fill it in. */
+		len = s->len - start - 4;
+		for (i = 0; i < 4; i++)
+			s->str[start + i] = (len >> (i * 8)) & 0xff;
+		break;
+	default:
+		if (samples)
+			g_string_append_printf(s, "%" PRIu64 "-%" PRIu64 " ",
+					pdata->start_sample, pdata->end_sample);
+		g_string_append_printf(s, "%s: ", pdata->pdo->proto_id);
+		for (i = 0; annotations[i]; i++)
+			g_string_append_printf(s, "\"%s\" ", annotations[i]);
+		g_string_append_c(s, '\n');
+	}
+}
@@ -0,0 +1,291 @@
+/*
+ * This file is part of the sigrok project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "sigrok-cli.h"
+
+#ifdef HAVE_FORK
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#define HAVE_BATCH 1
+#endif
+
+/*
+ * Several input files are each processed in a process of their own,
+ * forked from sigrok-cli once libsigrok and the protocol decoders are set
+ * up. Starting up, and loading the decoders in particular, takes far
+ * longer than forking, and each file still starts out with decoders
+ * which have never seen a sample. Up to --jobs files are processed at a
+ * time.
+ *
+ * What each process writes to stdout goes into a temporary file, and is
+ * copied to stdout once all files before it are done, so the output comes
+ * out in the order the files were given in, whichever finishes first.
+ */
+
+static gboolean has_wildcard(const char *str)
+{
+	return strpbrk(str, "*?") != NULL;
+}
+
+static gint name_cmp(gconstpointer a, gconstpointer b)
+{
+	return strcmp(*(const char **)a, *(const char **)b);
+}
+
+/* Add the files matching a wildcard pattern, in sorted order. */
+static int glob_add(GPtrArray *files, const char *pattern)
+{
+	GPtrArray *matches;
+	GError *error;
+	GDir *dir;
+	const char *name;
+	char *dirname, *base;
+	guint i;
+
+	dirname = g_path_get_dirname(pattern);
+	base = g_path_get_basename(pattern);
+	error = NULL;
+	if (!(dir = g_dir_open(dirname, 0, &error))) {
+		g_critical("Failed to read %s: %s.", dirname, error->message);
+		g_error_free(error);
+		g_free(dirname);
+		g_free(base);
+		return SR_ERR;
+	}
+
+	matches = g_ptr_array_new();
+	while ((name = g_dir_read_name(dir))) {
+		if (!g_pattern_match_simple(base, name))
+			continue;
+		/* "./" isn't added to names without a directory. */
+		if (!strcmp(dirname, ".") && strncmp(pattern, "./", 2))
+			g_ptr_array_add(matches, g_strdup(name));
+		else
+			g_ptr_array_add(matches, g_build_filename(dirname,
+					name, NULL));
+	}
+	g_dir_close(dir);
+	g_free(dirname);
+	g_free(base);
+
+	if (!matches->len) {
+		g_critical("No input files match %s.", pattern);
+		g_ptr_array_free(matches, TRUE);
+		return SR_ERR;
+	}
+	g_ptr_array_sort(matches, name_cmp);
+	for (i = 0; i < matches->len; i++)
+		g_ptr_array_add(files, g_ptr_array_index(matches, i));
+	g_ptr_array_free(matches, TRUE);
+
+	return SR_OK;
+}
+
+/**
+ * Get the input files from what was given with -i: file names, or
+ * patterns with wildcards in the last part.
+ *
+ * @param args The -i arguments. NULL-terminated.
+ *
+ * @return The files, NULL-terminated, to be freed with g_strfreev(), or
+ *         NULL upon errors.
+ */
+char **batch_expand(char **args)
+{
+	GPtrArray *files;
+	int i;
+
+	files = g_ptr_array_new();
+	for (i = 0; args[i]; i++) {
+		/* A file may well have a '*' in its name. */
+		if (!has_wildcard(args[i])
+				|| g_file_test(args[i], G_FILE_TEST_EXISTS)) {
+			g_ptr_array_add(files, g_strdup(args[i]));
+		} else if (glob_add(files, args[i]) != SR_OK) {
+			g_ptr_array_add(files, NULL);
+			g_strfreev((char **)g_ptr_array_free(files, FALSE));
+			return NULL;
+		}
+	}
+	g_ptr_array_add(files, NULL);
+
+	return (char **)g_ptr_array_free(files, FALSE);
+}
+
+#ifdef HAVE_BATCH
+
+struct batch_job {
+	pid_t pid;
+	/* Where its stdout went. */
+	FILE *out;
+	gboolean done;
+	gboolean failed;
+};
+
+static pid_t job_start(const char *filename, struct batch_job *job,
+		batch_file_cb run)
+{
+	pid_t pid;
+	int ret;
+
+	if (!(job->out = tmpfile())) {
+		g_critical("Failed to create temporary file: %s.",
+				strerror(errno));
+		return -1;
+	}
+
+	fflush(NULL);
+	if ((pid = fork()) < 0) {
+		g_critical("Failed to start batch worker: %s.",
+				strerror(errno));
+		fclose(job->out);
+		job->out = NULL;
+		return -1;
+	}
+	if (pid == 0) {
+		/* Worker process. */
+		if (dup2(fileno(job->out), STDOUT_FILENO) < 0)
+			_exit(1);
+		g_debug("cli: Batch worker %d: %s.", (int)getpid(), filename);
+		ret = run(filename);
+		fflush(NULL);
+		/* Leave whatever was set up before the fork to the parent. */
+		_exit(ret == SR_OK ? 0 : 1);
+	}
+
+	return pid;
+}
+
+/* Copy a finished job's output to stdout. */
+static void job_output(struct batch_job *job)
+{
+	char buf[65536];
+	size_t len;
+
+	if (!job->out)
+		return;
+
+	rewind(job->out);
+	while ((len = fread(buf, 1, sizeof(buf), job->out)) > 0)
+		fwrite(buf, 1, len, stdout);
+	fflush(stdout);
+	fclose(job->out);
+	job->out = NULL;
+}
+
+/**
+ * Process several input files, each in a worker process of its own.
+ *
+ * @param files The input files, NULL-terminated.
+ * @param jobs The maximum number of files to process at once.
+ * @param run Processes a file, in the worker process.
+ *
+ * @return SR_OK if all files were processed, SR_ERR if any failed.
+ */
+int batch_run(char **files, int jobs, batch_file_cb run)
+{
+	struct batch_job *job;
+	pid_t pid;
+	int num_files, running, next, printed, status, i;
+	gboolean failed;
+
+	num_files = g_strv_length(files);
+	if (!(job = g_try_malloc0(num_files * sizeof(struct batch_job)))) {
+		g_critical("Batch malloc failed.");
+		return SR_ERR_MALLOC;
+	}
+
+	running = next = printed = 0;
+	failed = FALSE;
+	while (printed < num_files) {
+		/*
+		 * Keep the workers busy, but don't let the output of files
+		 * waiting for an earlier one to finish pile up without
+		 * bounds.
+		 */
+		while (!failed && running < jobs && next < num_files
+				&& next - printed < jobs * 8) {
+			if ((job[next].pid = job_start(files[next], &job[next],
+					run)) < 0) {
+				/* Finish what's running, then stop. */
+				failed = TRUE;
+				break;
+			}
+			next++;
+			running++;
+		}
+		if (running == 0)
+			break;
+
+		if ((pid = waitpid(-1, &status, 0)) < 0) {
+			if (errno == EINTR)
+				continue;
+			g_critical("Failed to wait for batch workers: %s.",
+					strerror(errno));
+			failed = TRUE;
+			break;
+		}
+		for (i = printed; i < next && job[i].pid != pid; i++)
+			;
+		if (i == next)
+			continue;
+		running--;
+		job[i].done = TRUE;
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			g_critical("Processing %s failed.", files[i]);
+			job[i].failed = TRUE;
+		}
+
+		while (printed < next && job[printed].done)
+			job_output(&job[printed++]);
+	}
+
+	for (i = 0; i < num_files; i++) {
+		if (job[i].out)
+			fclose(job[i].out);
+		failed |= job[i].failed;
+	}
+	g_free(job);
+
+	return failed ? SR_ERR : SR_OK;
+}
+
+#else
+
+int batch_run(char **files, int jobs, batch_file_cb run)
+{
+	(void)files;
+	(void)jobs;
+	(void)run;
+
+	g_critical("Several input files are not supported on this platform.");
+
+	return SR_ERR;
+}
+
+#endif
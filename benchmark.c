@@ -0,0 +1,359 @@
+/*
+ * This file is part of the sigrok project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sigrokdecode.h> /* First, so we avoid a _POSIX_C_SOURCE warning. */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libsigrok/libsigrok.h>
+#include "sigrok-cli.h"
+
+/*
+ * Every stage of the datafeed pipeline is fed the same synthetic samples,
+ * at full speed and on its own, so a slow stage stands out. Each stage is
+ * run a few times and the fastest run is reported, which keeps the numbers
+ * steady enough to compare one build against another.
+ */
+
+#define BENCH_RUNS 3
+#define BENCH_PACKET_SIZE (64 * 1024)
+#define BENCH_SAMPLERATE SR_MHZ(1)
+#define BENCH_SEED 0x2545f491
+
+struct bench {
+	const struct sr_dev_inst *sdi;
+	char *param;
+	uint64_t num_samples;
+	/* Samples as the device sends them, all probes. */
+	uint8_t *raw;
+	uint64_t raw_len;
+	int raw_unitsize;
+	/* Samples after the probe filter, enabled probes only. */
+	uint8_t *data;
+	uint64_t len;
+	int unitsize;
+	int probelist[SR_MAX_NUM_PROBES + 1];
+	int num_probes;
+	int num_enabled_probes;
+};
+
+typedef int (*bench_func)(struct bench *b, void *arg);
+
+/*
+ * Every probe toggles now and then, about one sample in eight, which is
+ * busier than most real signals but nowhere near random noise.
+ */
+static void bench_fill(uint8_t *buf, uint64_t len)
+{
+	uint32_t x, toggle;
+	uint8_t state;
+	uint64_t i;
+
+	x = BENCH_SEED;
+	state = 0;
+	for (i = 0; i < len; i++) {
+		/* xorshift32 */
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		toggle = x & (x >> 8) & (x >> 16);
+		state ^= toggle;
+		buf[i] = state;
+	}
+}
+
+/* Whole samples only, so none are split between packets. */
+static uint64_t packet_size(int unitsize)
+{
+	return BENCH_PACKET_SIZE / unitsize * unitsize;
+}
+
+static int bench_filter(struct bench *b, void *arg)
+{
+	struct probe_filter *pf;
+	const uint8_t *out;
+	uint64_t offset, len, out_len;
+	int ret;
+
+	(void)arg;
+
+	if (!(pf = probe_filter_new(b->raw_unitsize, b->unitsize,
+			b->probelist)))
+		return SR_ERR;
+
+	ret = SR_OK;
+	for (offset = 0; offset < b->raw_len && ret == SR_OK; offset += len) {
+		len = MIN(packet_size(b->raw_unitsize), b->raw_len - offset);
+		ret = probe_filter_run(pf, b->raw + offset, len, &out, &out_len);
+	}
+	probe_filter_destroy(pf);
+
+	return ret;
+}
+
+/* Run the probe filter once, untimed, for the stages after it. */
+static int bench_filtered(struct bench *b)
+{
+	struct probe_filter *pf;
+	const uint8_t *out;
+	uint64_t offset, len, out_len, pos;
+	int ret;
+
+	if (!(pf = probe_filter_new(b->raw_unitsize, b->unitsize,
+			b->probelist)))
+		return SR_ERR;
+
+	ret = SR_OK;
+	pos = 0;
+	for (offset = 0; offset < b->raw_len && ret == SR_OK; offset += len) {
+		len = MIN(packet_size(b->raw_unitsize), b->raw_len - offset);
+		if ((ret = probe_filter_run(pf, b->raw + offset, len, &out,
+				&out_len)) != SR_OK)
+			break;
+		memcpy(b->data + pos, out, out_len);
+		pos += out_len;
+	}
+	probe_filter_destroy(pf);
+
+	return ret;
+}
+
+static int bench_output(struct bench *b, void *arg)
+{
+	struct sr_output o;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	struct sr_output_format *format;
+	uint64_t offset, len, out_len;
+	uint8_t *out;
+
+	format = arg;
+	o.format = format;
+	o.sdi = (struct sr_dev_inst *)b->sdi;
+	o.param = b->param;
+	o.internal = NULL;
+	if (format->init && format->init(&o) != SR_OK)
+		return SR_ERR;
+
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.unitsize = b->unitsize;
+	for (offset = 0; offset < b->len; offset += len) {
+		len = MIN(packet_size(b->unitsize), b->len - offset);
+		if (format->data) {
+			out = NULL;
+			format->data(&o, b->data + offset, len, &out, &out_len);
+			g_free(out);
+		}
+		if (format->recv) {
+			logic.length = len;
+			logic.data = b->data + offset;
+			format->recv(&o, b->sdi, &packet);
+		}
+	}
+	if (format->event) {
+		out = NULL;
+		format->event(&o, SR_DF_END, &out, &out_len);
+		g_free(out);
+	}
+	if (format->cleanup)
+		format->cleanup(&o);
+
+	return SR_OK;
+}
+
+static int bench_decode(struct bench *b, void *arg)
+{
+	uint64_t offset, len;
+
+	(void)arg;
+
+	if (srd_session_start(b->num_enabled_probes, b->unitsize,
+			BENCH_SAMPLERATE) != SRD_OK)
+		return SR_ERR;
+
+	for (offset = 0; offset < b->len; offset += len) {
+		len = MIN(packet_size(b->unitsize), b->len - offset);
+		if (srd_session_send(offset / b->unitsize, b->data + offset,
+				len) != SRD_OK)
+			return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+static int bench_session(struct bench *b, void *arg)
+{
+	struct session_file *sf;
+	struct timeval starttime;
+	uint64_t offset, len;
+	const char *filename;
+	int ret;
+
+	filename = arg;
+	gettimeofday(&starttime, NULL);
+	if (!(sf = session_file_new(filename, b->sdi, b->unitsize,
+			BENCH_SAMPLERATE, &starttime)))
+		return SR_ERR;
+
+	ret = SR_OK;
+	for (offset = 0; offset < b->len && ret == SR_OK; offset += len) {
+		len = MIN(packet_size(b->unitsize), b->len - offset);
+		ret = session_file_append(sf, b->data + offset, len);
+	}
+	if (session_file_close(sf) != SR_OK)
+		ret = SR_ERR;
+
+	return ret;
+}
+
+/* Run one stage a few times, and report the fastest run. */
+static int bench_stage(struct bench *b, const char *stage, bench_func func,
+		void *arg, uint64_t bytes)
+{
+	gint64 start, t, best;
+	double secs;
+	int i;
+
+	best = 0;
+	for (i = 0; i < BENCH_RUNS; i++) {
+		start = g_get_monotonic_time();
+		if (func(b, arg) != SR_OK) {
+			g_critical("Benchmark stage %s failed.", stage);
+			return SR_ERR;
+		}
+		t = g_get_monotonic_time() - start;
+		if (i == 0 || t < best)
+			best = t;
+	}
+
+	/* The clock has microsecond resolution; don't divide by zero. */
+	secs = MAX(best, 1) / 1000000.0;
+	printf("%s,%" PRIu64 ",%" PRIu64 ",%.6f,%.0f,%.2f\n", stage,
+			b->num_samples, bytes, secs, b->num_samples / secs,
+			bytes / secs / 1000000.0);
+	fflush(stdout);
+
+	return SR_OK;
+}
+
+/**
+ * Benchmark the stages of the datafeed pipeline, and print the results
+ * as comma-separated values, one line per stage.
+ *
+ * @param sdi The device whose probes the samples are for. It is not used
+ *            for capturing.
+ * @param formats The output formats to benchmark.
+ * @param param Output format parameter, or NULL.
+ * @param decode If TRUE, also benchmark the protocol decoders, which must
+ *               already be set up.
+ * @param num_samples Number of samples to feed to each stage.
+ *
+ * @return SR_OK upon success, or an SR_ERR* code upon errors.
+ */
+int benchmark_run(const struct sr_dev_inst *sdi, GSList *formats,
+		const char *param, gboolean decode, uint64_t num_samples)
+{
+	struct bench b;
+	struct sr_probe *probe;
+	struct sr_output_format *format;
+	GSList *l;
+	GError *error;
+	char *filename, *stage;
+	int fd, ret;
+
+	memset(&b, 0, sizeof(struct bench));
+	b.sdi = sdi;
+	b.param = (char *)param;
+	b.num_samples = num_samples;
+	for (l = sdi->probes; l; l = l->next) {
+		probe = l->data;
+		if (probe->type != SR_PROBE_LOGIC)
+			continue;
+		if (probe->enabled)
+			b.probelist[b.num_enabled_probes++] = probe->index;
+		b.num_probes++;
+	}
+	b.probelist[b.num_enabled_probes] = -1;
+	if (b.num_enabled_probes == 0) {
+		g_critical("No logic probes enabled to benchmark.");
+		return SR_ERR_ARG;
+	}
+	b.raw_unitsize = (b.num_probes + 7) / 8;
+	b.unitsize = (b.num_enabled_probes + 7) / 8;
+	b.raw_len = num_samples * b.raw_unitsize;
+	b.len = num_samples * b.unitsize;
+
+	if (!(b.raw = g_try_malloc(b.raw_len))
+			|| !(b.data = g_try_malloc(b.len))) {
+		g_critical("Benchmark malloc failed.");
+		g_free(b.raw);
+		return SR_ERR_MALLOC;
+	}
+	bench_fill(b.raw, b.raw_len);
+	/* The later stages get what the probe filter makes of it. */
+	if ((ret = bench_filtered(&b)) != SR_OK) {
+		g_critical("Benchmark probe filter failed.");
+		goto done;
+	}
+
+	printf("stage,samples,bytes,seconds,samples_per_sec,mb_per_sec\n");
+
+	if ((ret = bench_stage(&b, "filter", bench_filter, NULL,
+			b.raw_len)) != SR_OK)
+		goto done;
+
+	for (l = formats; l; l = l->next) {
+		format = l->data;
+		stage = g_strdup_printf("output:%s", format->id);
+		ret = bench_stage(&b, stage, bench_output, format, b.len);
+		g_free(stage);
+		if (ret != SR_OK)
+			goto done;
+	}
+
+	if (decode && (ret = bench_stage(&b, "decode", bench_decode, NULL,
+			b.len)) != SR_OK)
+		goto done;
+
+	error = NULL;
+	if ((fd = g_file_open_tmp("sigrok-cli-XXXXXX.sr", &filename,
+			&error)) < 0) {
+		g_critical("Failed to create session file: %s.",
+				error->message);
+		g_error_free(error);
+		ret = SR_ERR;
+		goto done;
+	}
+	close(fd);
+	ret = bench_stage(&b, "session", bench_session, filename, b.len);
+	g_unlink(filename);
+	g_free(filename);
+
+done:
+	g_free(b.raw);
+	g_free(b.data);
+
+	return ret;
+}
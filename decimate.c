@@ -0,0 +1,277 @@
+/*
+ * This file is part of the sigrok project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "sigrok-cli.h"
+
+/*
+ * Cut the samples down to one for every so many, for an overview of a long
+ * capture. Logic samples are either just picked out, or ORed or ANDed
+ * together over each window of samples, so a pulse shorter than a window
+ * still shows. Analog samples become the lowest and the highest value in
+ * each window. Windows carry over from one packet to the next.
+ */
+
+#define DECIMATE_MAX_UNITSIZE 8
+
+struct decimator {
+	uint64_t factor;
+	int mode;
+	/* Bytes in a logic sample, or floats in an analog one. */
+	int width;
+	/* How far into the current window the samples so far got. */
+	uint64_t pos;
+	/* What the current window comes to so far. */
+	uint8_t acc[DECIMATE_MAX_UNITSIZE];
+	float *min;
+	float *max;
+	uint8_t *buf;
+	uint64_t bufsize;
+};
+
+/**
+ * Set up decimation for one kind of sample.
+ *
+ * @param factor Number of samples to turn into one.
+ * @param mode One of the DECIMATE_* modes, for logic samples.
+ * @param width Size of a logic sample in bytes, or number of analog probes.
+ *
+ * @return The decimator, or NULL upon errors.
+ */
+struct decimator *decimator_new(uint64_t factor, int mode, int width)
+{
+	struct decimator *dc;
+
+	if (!(dc = g_try_malloc0(sizeof(struct decimator)))) {
+		g_critical("Decimator malloc failed.");
+		return NULL;
+	}
+	dc->factor = factor;
+	dc->mode = mode;
+	dc->width = width;
+	if (!(dc->min = g_try_malloc(width * sizeof(float)))
+			|| !(dc->max = g_try_malloc(width * sizeof(float)))) {
+		g_critical("Decimator malloc failed.");
+		decimator_destroy(dc);
+		return NULL;
+	}
+
+	return dc;
+}
+
+static int buf_reserve(struct decimator *dc, uint64_t size)
+{
+	uint8_t *buf;
+
+	if (size <= dc->bufsize)
+		return SR_OK;
+	if (!(buf = g_try_realloc(dc->buf, size))) {
+		g_critical("Decimator buffer malloc failed.");
+		return SR_ERR_MALLOC;
+	}
+	dc->buf = buf;
+	dc->bufsize = size;
+
+	return SR_OK;
+}
+
+static inline void combine(uint8_t *out, const uint8_t *p, int len,
+		gboolean and)
+{
+	int b;
+
+	for (b = 0; b < len; b++)
+		out[b] = and ? out[b] & p[b] : out[b] | p[b];
+}
+
+/*
+ * OR or AND num_samples samples together. When a sample fits a 64-bit word
+ * a whole number of times, a word's worth of samples is done at once, and
+ * the lanes of the result folded into one sample at the end.
+ */
+static void reduce(uint8_t *out, const uint8_t *p, uint64_t num_samples,
+		int unitsize, gboolean and)
+{
+	uint64_t len, i, w, x;
+	int s;
+
+	len = num_samples * unitsize;
+	memcpy(out, p, unitsize);
+	i = unitsize;
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+	if (8 % unitsize == 0 && len >= 8) {
+		w = and ? ~(uint64_t)0 : 0;
+		for (i = 0; i + 8 <= len; i += 8) {
+			memcpy(&x, p + i, 8);
+			w = and ? w & x : w | x;
+		}
+		for (s = 32; s >= unitsize * 8; s /= 2)
+			w = and ? w & (w >> s) : w | (w >> s);
+		memcpy(out, &w, unitsize);
+	}
+#endif
+	for (; i < len; i += unitsize)
+		combine(out, p + i, unitsize, and);
+}
+
+/**
+ * Decimate logic samples.
+ *
+ * @param dc The decimator.
+ * @param data The samples.
+ * @param len Length of the samples, in bytes.
+ * @param out Set to the decimated samples, which stay valid until the next
+ *            call.
+ *
+ * @return Length of the decimated samples, in bytes.
+ */
+uint64_t decimate_logic(struct decimator *dc, const uint8_t *data,
+		uint64_t len, const uint8_t **out)
+{
+	uint64_t num_samples, n, i, o;
+	uint8_t tmp[DECIMATE_MAX_UNITSIZE];
+	int u;
+	gboolean and;
+
+	u = dc->width;
+	num_samples = len / u;
+	/* Trimming to a limit can leave nothing; the window goes on. */
+	if (num_samples == 0)
+		return 0;
+	if (buf_reserve(dc, (num_samples / dc->factor + 1) * u) != SR_OK)
+		return 0;
+	*out = dc->buf;
+
+	o = 0;
+	if (dc->mode == DECIMATE_SAMPLE) {
+		/* The first sample of every window is kept. */
+		for (i = (dc->factor - dc->pos) % dc->factor; i < num_samples;
+				i += dc->factor)
+			memcpy(dc->buf + o++ * u, data + i * u, u);
+		dc->pos = (dc->pos + num_samples) % dc->factor;
+		return o * u;
+	}
+
+	and = dc->mode == DECIMATE_AND;
+	i = 0;
+	/* Finish the window left over from the last packet. */
+	if (dc->pos) {
+		n = MIN(dc->factor - dc->pos, num_samples);
+		reduce(tmp, data, n, u, and);
+		combine(dc->acc, tmp, u, and);
+		if ((dc->pos += n) == dc->factor) {
+			memcpy(dc->buf + o++ * u, dc->acc, u);
+			dc->pos = 0;
+		}
+		i = n;
+	}
+	for (; i + dc->factor <= num_samples; i += dc->factor)
+		reduce(dc->buf + o++ * u, data + i * u, dc->factor, u, and);
+	if (i < num_samples) {
+		reduce(dc->acc, data + i * u, num_samples - i, u, and);
+		dc->pos = num_samples - i;
+	}
+
+	return o * u;
+}
+
+/**
+ * Decimate analog samples: every window becomes two samples, one with the
+ * lowest value each probe had in it, followed by one with the highest.
+ *
+ * @param dc The decimator.
+ * @param data The samples, one float per probe each.
+ * @param num_samples Number of samples.
+ * @param out Set to the decimated samples, which stay valid until the next
+ *            call.
+ *
+ * @return Number of decimated samples.
+ */
+uint64_t decimate_analog(struct decimator *dc, const float *data,
+		uint64_t num_samples, const float **out)
+{
+	const float *p;
+	float *min, *max, *o;
+	uint64_t i, n;
+	int np, j;
+
+	np = dc->width;
+	if (buf_reserve(dc, (num_samples / dc->factor + 1) * 2 * np
+			* sizeof(float)) != SR_OK)
+		return 0;
+	*out = o = (float *)dc->buf;
+
+	min = dc->min;
+	max = dc->max;
+	n = 0;
+	for (i = 0; i < num_samples; i++) {
+		p = data + i * np;
+		if (dc->pos == 0) {
+			memcpy(min, p, np * sizeof(float));
+			memcpy(max, p, np * sizeof(float));
+		} else {
+			for (j = 0; j < np; j++) {
+				min[j] = p[j] < min[j] ? p[j] : min[j];
+				max[j] = p[j] > max[j] ? p[j] : max[j];
+			}
+		}
+		if (++dc->pos == dc->factor) {
+			memcpy(o + n++ * np, min, np * sizeof(float));
+			memcpy(o + n++ * np, max, np * sizeof(float));
+			dc->pos = 0;
+		}
+	}
+
+	return n;
+}
+
+/**
+ * Get what the last, unfinished window of logic samples came to, so the
+ * end of a capture isn't lost.
+ *
+ * @param dc The decimator.
+ * @param out Set to the sample.
+ *
+ * @return Length of the sample, in bytes, or 0 if there's none.
+ */
+uint64_t decimate_logic_flush(struct decimator *dc, const uint8_t **out)
+{
+	if (dc->mode == DECIMATE_SAMPLE || dc->pos == 0)
+		return 0;
+
+	dc->pos = 0;
+	*out = dc->acc;
+
+	return dc->width;
+}
+
+void decimator_destroy(struct decimator *dc)
+{
+	if (!dc)
+		return;
+
+	g_free(dc->buf);
+	g_free(dc->min);
+	g_free(dc->max);
+	g_free(dc);
+}
@@ -0,0 +1,449 @@
+/*
+ * This file is part of the sigrok project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "sigrok-cli.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define HAVE_PEXT_KERNEL 1
+#define HAVE_AVX2_KERNEL 1
+#endif
+
+typedef void (*gather_func)(const struct probe_filter *pf,
+		const uint8_t *in, uint8_t *out, uint64_t num_samples);
+
+struct probe_filter {
+	int in_unitsize;
+	int out_unitsize;
+	/* Every probe is enabled and in place, data passes through as-is. */
+	gboolean identity;
+	/* Enabled probe bits within one input sample. */
+	uint64_t mask;
+	/* Per input byte lookup: byte value -> packed output bits. */
+	uint64_t lut[8][256];
+	gather_func gather;
+	uint8_t *buf;
+	uint64_t bufsize;
+};
+
+static inline uint64_t load_sample(const uint8_t *p, int unitsize)
+{
+	uint64_t v;
+	int i;
+
+	v = 0;
+	for (i = 0; i < unitsize; i++)
+		v |= (uint64_t)p[i] << (i * 8);
+
+	return v;
+}
+
+static inline void store_sample(uint8_t *p, uint64_t v, int unitsize)
+{
+	int i;
+
+	for (i = 0; i < unitsize; i++)
+		p[i] = v >> (i * 8);
+}
+
+static void gather_lut_1to1(const struct probe_filter *pf,
+		const uint8_t *in, uint8_t *out, uint64_t num_samples)
+{
+	uint64_t i;
+
+	for (i = 0; i < num_samples; i++)
+		out[i] = pf->lut[0][in[i]];
+}
+
+static void gather_lut_2to1(const struct probe_filter *pf,
+		const uint8_t *in, uint8_t *out, uint64_t num_samples)
+{
+	uint64_t i;
+
+	for (i = 0; i < num_samples; i++, in += 2)
+		out[i] = pf->lut[0][in[0]] | pf->lut[1][in[1]];
+}
+
+static void gather_lut(const struct probe_filter *pf,
+		const uint8_t *in, uint8_t *out, uint64_t num_samples)
+{
+	uint64_t i, v;
+	int b;
+
+	for (i = 0; i < num_samples; i++) {
+		v = 0;
+		for (b = 0; b < pf->in_unitsize; b++)
+			v |= pf->lut[b][in[b]];
+		store_sample(out, v, pf->out_unitsize);
+		in += pf->in_unitsize;
+		out += pf->out_unitsize;
+	}
+}
+
+#ifdef HAVE_PEXT_KERNEL
+__attribute__((target("bmi2")))
+static void gather_pext(const struct probe_filter *pf,
+		const uint8_t *in, uint8_t *out, uint64_t num_samples)
+{
+	uint64_t i, v;
+
+	for (i = 0; i < num_samples; i++) {
+		v = _pext_u64(load_sample(in, pf->in_unitsize), pf->mask);
+		store_sample(out, v, pf->out_unitsize);
+		in += pf->in_unitsize;
+		out += pf->out_unitsize;
+	}
+}
+
+/*
+ * PEXT is only worth it where it's implemented in hardware: AMD CPUs
+ * before Zen 3 (family 0x19) microcode it at hundreds of cycles, which
+ * is slower than the lookup tables.
+ */
+static gboolean have_fast_pext(void)
+{
+	unsigned int eax, ebx, ecx, edx, family;
+
+	if (__get_cpuid_max(0, NULL) < 7)
+		return FALSE;
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	if (!(ebx & bit_BMI2))
+		return FALSE;
+
+	__cpuid(0, eax, ebx, ecx, edx);
+	if (ebx == 0x68747541) {
+		/* "AuthenticAMD" */
+		__cpuid(1, eax, ebx, ecx, edx);
+		family = (eax >> 8) & 0x0f;
+		if (family == 0x0f)
+			family += (eax >> 20) & 0xff;
+		if (family < 0x19)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+#endif
+
+/**
+ * Create a filter which packs the given probes out of each sample.
+ *
+ * @param in_unitsize Size of one incoming sample, in bytes.
+ * @param out_unitsize Size of one packed sample, in bytes.
+ * @param probelist Indices of the enabled probes, terminated by -1.
+ *
+ * @return A new filter, or NULL on error.
+ */
+struct probe_filter *probe_filter_new(int in_unitsize, int out_unitsize,
+		const int *probelist)
+{
+	struct probe_filter *pf;
+	int i, v;
+
+	if (in_unitsize < 1 || in_unitsize > 8 || out_unitsize < 1
+			|| out_unitsize > in_unitsize) {
+		g_critical("Invalid probe filter unitsize %d -> %d.",
+				in_unitsize, out_unitsize);
+		return NULL;
+	}
+
+	if (!(pf = g_try_malloc0(sizeof(struct probe_filter)))) {
+		g_critical("Probe filter malloc failed.");
+		return NULL;
+	}
+	pf->in_unitsize = in_unitsize;
+	pf->out_unitsize = out_unitsize;
+
+	for (i = 0; probelist[i] != -1; i++) {
+		if (probelist[i] >= in_unitsize * 8) {
+			g_critical("Probe %d doesn't fit in a %d-byte sample.",
+					probelist[i], in_unitsize);
+			g_free(pf);
+			return NULL;
+		}
+		pf->mask |= (uint64_t)1 << probelist[i];
+		for (v = 0; v < 256; v++) {
+			if (v & (1 << (probelist[i] % 8)))
+				pf->lut[probelist[i] / 8][v] |= (uint64_t)1 << i;
+		}
+	}
+
+	/*
+	 * Samples can only be passed through as they are if every bit in
+	 * them is an enabled probe: bits past the device's last probe
+	 * aren't guaranteed to be zero.
+	 */
+	pf->identity = (in_unitsize == out_unitsize);
+	if (i != in_unitsize * 8)
+		pf->identity = FALSE;
+	for (i = 0; probelist[i] != -1; i++) {
+		if (probelist[i] != i)
+			pf->identity = FALSE;
+	}
+
+	if (in_unitsize == 1 && out_unitsize == 1)
+		pf->gather = gather_lut_1to1;
+	else if (in_unitsize == 2 && out_unitsize == 1)
+		pf->gather = gather_lut_2to1;
+	else
+		pf->gather = gather_lut;
+#ifdef HAVE_PEXT_KERNEL
+	/* The single-table lookup is as fast as it gets. */
+	if (in_unitsize > 2 && have_fast_pext())
+		pf->gather = gather_pext;
+#endif
+
+	g_debug("cli: Probe filter %d -> %d bytes/sample%s.", in_unitsize,
+			out_unitsize, pf->identity ? ", pass-through" : "");
+
+	return pf;
+}
+
+/**
+ * Pack the enabled probes out of a block of samples.
+ *
+ * The result stays valid until the next call on this filter. If all probes
+ * are enabled, no copy is made and the result points into data_in.
+ *
+ * @param pf The filter to use.
+ * @param data_in The incoming samples.
+ * @param length_in Size of the incoming samples, in bytes.
+ * @param data_out Will point to the packed samples.
+ * @param length_out Will be set to the size of the packed samples, in bytes.
+ *
+ * @return SR_OK upon success, SR_ERR_MALLOC upon memory shortage.
+ */
+int probe_filter_run(struct probe_filter *pf, const uint8_t *data_in,
+		uint64_t length_in, const uint8_t **data_out,
+		uint64_t *length_out)
+{
+	uint64_t num_samples, len;
+	uint8_t *buf;
+
+	if (pf->identity) {
+		*data_out = data_in;
+		*length_out = length_in;
+		return SR_OK;
+	}
+
+	num_samples = length_in / pf->in_unitsize;
+	len = num_samples * pf->out_unitsize;
+	if (len > pf->bufsize) {
+		if (!(buf = g_try_realloc(pf->buf, len))) {
+			g_critical("Probe filter buffer malloc failed.");
+			return SR_ERR_MALLOC;
+		}
+		pf->buf = buf;
+		pf->bufsize = len;
+	}
+	pf->gather(pf, data_in, pf->buf, num_samples);
+
+	*data_out = pf->buf;
+	*length_out = len;
+
+	return SR_OK;
+}
+
+int probe_filter_in_unitsize_get(const struct probe_filter *pf)
+{
+	return pf->in_unitsize;
+}
+
+void probe_filter_destroy(struct probe_filter *pf)
+{
+	if (!pf)
+		return;
+	g_free(pf->buf);
+	g_free(pf);
+}
+
+/*
+ * Analog samples come in as one float per probe, one sample after the
+ * other. The analog filter copies out the enabled probes' values.
+ */
+
+typedef void (*analog_gather_func)(const struct analog_filter *af,
+		const float *in, float *out, uint64_t num_samples);
+
+struct analog_filter {
+	/* Floats in one incoming sample. */
+	int num_probes;
+	int num_enabled;
+	int probelist[SR_MAX_NUM_PROBES];
+	gboolean identity;
+	analog_gather_func gather;
+	float *buf;
+	uint64_t bufsize;
+};
+
+static void analog_gather_one(const struct analog_filter *af,
+		const float *in, float *out, uint64_t num_samples)
+{
+	uint64_t i;
+
+	in += af->probelist[0];
+	for (i = 0; i < num_samples; i++)
+		out[i] = in[i * af->num_probes];
+}
+
+static void analog_gather(const struct analog_filter *af,
+		const float *in, float *out, uint64_t num_samples)
+{
+	uint64_t i;
+	int p;
+
+	for (i = 0; i < num_samples; i++) {
+		for (p = 0; p < af->num_enabled; p++)
+			out[p] = in[af->probelist[p]];
+		in += af->num_probes;
+		out += af->num_enabled;
+	}
+}
+
+#ifdef HAVE_AVX2_KERNEL
+/* Eight samples of one probe at a time. */
+__attribute__((target("avx2")))
+static void analog_gather_one_avx2(const struct analog_filter *af,
+		const float *in, float *out, uint64_t num_samples)
+{
+	__m256i idx;
+	uint64_t i;
+	int n;
+
+	n = af->num_probes;
+	in += af->probelist[0];
+	idx = _mm256_setr_epi32(0, n, 2 * n, 3 * n, 4 * n, 5 * n, 6 * n,
+			7 * n);
+	for (i = 0; i + 8 <= num_samples; i += 8)
+		_mm256_storeu_ps(out + i, _mm256_i32gather_ps(in + i * n,
+				idx, 4));
+	for (; i < num_samples; i++)
+		out[i] = in[i * n];
+}
+#endif
+
+/**
+ * Create a filter which copies the given probes out of each analog sample.
+ *
+ * @param probelist Positions of the enabled probes within a sample,
+ *                  terminated by -1.
+ * @param num_probes Number of floats in a sample.
+ *
+ * @return A new filter, or NULL on error.
+ */
+struct analog_filter *analog_filter_new(const int *probelist, int num_probes)
+{
+	struct analog_filter *af;
+	int i;
+
+	if (num_probes < 1 || num_probes > SR_MAX_NUM_PROBES) {
+		g_critical("Invalid number of analog probes %d.", num_probes);
+		return NULL;
+	}
+
+	if (!(af = g_try_malloc0(sizeof(struct analog_filter)))) {
+		g_critical("Analog filter malloc failed.");
+		return NULL;
+	}
+	af->num_probes = num_probes;
+	af->identity = TRUE;
+	for (i = 0; probelist[i] != -1; i++) {
+		if (probelist[i] >= num_probes) {
+			g_critical("Analog probe %d is out of range.",
+					probelist[i]);
+			g_free(af);
+			return NULL;
+		}
+		af->probelist[i] = probelist[i];
+		if (probelist[i] != i)
+			af->identity = FALSE;
+	}
+	af->num_enabled = i;
+	if (i != num_probes)
+		af->identity = FALSE;
+
+	if (af->num_enabled == 1)
+		af->gather = analog_gather_one;
+	else
+		af->gather = analog_gather;
+#ifdef HAVE_AVX2_KERNEL
+	/* The gather instruction takes 32-bit offsets, which is plenty. */
+	if (af->num_enabled == 1 && __builtin_cpu_supports("avx2"))
+		af->gather = analog_gather_one_avx2;
+#endif
+
+	g_debug("cli: Analog filter %d -> %d probes%s.", num_probes,
+			af->num_enabled, af->identity ? ", pass-through" : "");
+
+	return af;
+}
+
+/**
+ * Copy the enabled probes out of a block of analog samples.
+ *
+ * The result stays valid until the next call on this filter. If all probes
+ * are enabled, no copy is made and the result points into data_in.
+ *
+ * @param af The filter to use.
+ * @param data_in The incoming samples.
+ * @param num_samples Number of incoming samples.
+ * @param data_out Will point to the filtered samples, one float for each
+ *                 enabled probe per sample.
+ *
+ * @return SR_OK upon success, SR_ERR_MALLOC upon memory shortage.
+ */
+int analog_filter_run(struct analog_filter *af, const float *data_in,
+		uint64_t num_samples, const float **data_out)
+{
+	uint64_t len;
+	float *buf;
+
+	if (af->identity) {
+		*data_out = data_in;
+		return SR_OK;
+	}
+
+	len = num_samples * af->num_enabled;
+	if (len > af->bufsize) {
+		if (!(buf = g_try_realloc(af->buf, len * sizeof(float)))) {
+			g_critical("Analog filter buffer malloc failed.");
+			return SR_ERR_MALLOC;
+		}
+		af->buf = buf;
+		af->bufsize = len;
+	}
+	af->gather(af, data_in, af->buf, num_samples);
+	*data_out = af->buf;
+
+	return SR_OK;
+}
+
+void analog_filter_destroy(struct analog_filter *af)
+{
+	if (!af)
+		return;
+	g_free(af->buf);
+	g_free(af);
+}
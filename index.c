@@ -0,0 +1,300 @@
+/*
+ * This file is part of the sigrok project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libsigrok/libsigrok.h>
+#include "sigrok-cli.h"
+
+/*
+ * To get at a part of a big capture without reading through everything
+ * before it, a capture file gets an index: where in the file its samples
+ * start, or for files which only store the changes, a list of places where
+ * decoding can pick up. The index is built the first time it's needed, and
+ * kept next to the file, in <file>.idx. The file's size and modification
+ * time are in there too, so an index which no longer fits is rebuilt.
+ */
+
+#define INDEX_GROUP "index"
+
+static const char *index_kinds[] = {
+	[INDEX_SESSION] = "session",
+	[INDEX_TRANSITIONS] = "transitions",
+};
+
+static struct sample_index *sample_index_new(void)
+{
+	struct sample_index *idx;
+
+	if (!(idx = g_try_malloc0(sizeof(struct sample_index)))) {
+		g_critical("Index malloc failed.");
+		return NULL;
+	}
+	idx->points = g_array_new(FALSE, FALSE, sizeof(struct index_point));
+
+	return idx;
+}
+
+static int index_kind(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < G_N_ELEMENTS(index_kinds); i++) {
+		if (!strcmp(index_kinds[i], name))
+			return i;
+	}
+
+	return -1;
+}
+
+static int point_parse(const char *str, struct index_point *pt)
+{
+	char *end;
+	int i;
+
+	memset(pt, 0, sizeof(struct index_point));
+	pt->sample = g_ascii_strtoull(str, &end, 10);
+	if (*end++ != ':')
+		return SR_ERR;
+	pt->offset = g_ascii_strtoull(end, &end, 10);
+	if (*end++ != ':')
+		return SR_ERR;
+	for (i = 0; i < (int)sizeof(pt->value) && g_ascii_isxdigit(end[0])
+			&& g_ascii_isxdigit(end[1]); i++, end += 2)
+		pt->value[i] = g_ascii_xdigit_value(end[0]) << 4
+				| g_ascii_xdigit_value(end[1]);
+
+	return *end ? SR_ERR : SR_OK;
+}
+
+static struct sample_index *index_load(const char *path,
+		const struct stat *st)
+{
+	struct sample_index *idx;
+	struct index_point pt;
+	GKeyFile *kf;
+	char *kind, **points;
+	int i;
+
+	kf = g_key_file_new();
+	idx = NULL;
+	kind = NULL;
+	points = NULL;
+	if (!g_key_file_load_from_file(kf, path, G_KEY_FILE_NONE, NULL))
+		goto done;
+
+	/* Only good for the very same file. */
+	if (g_key_file_get_uint64(kf, INDEX_GROUP, "filesize", NULL)
+			!= (uint64_t)st->st_size
+			|| g_key_file_get_int64(kf, INDEX_GROUP, "mtime", NULL)
+			!= (gint64)st->st_mtime) {
+		g_debug("cli: Index %s is out of date.", path);
+		goto done;
+	}
+
+	if (!(idx = sample_index_new()))
+		goto done;
+	kind = g_key_file_get_string(kf, INDEX_GROUP, "kind", NULL);
+	idx->type = kind ? index_kind(kind) : -1;
+	idx->samplerate = g_key_file_get_uint64(kf, INDEX_GROUP, "samplerate",
+			NULL);
+	idx->unitsize = g_key_file_get_integer(kf, INDEX_GROUP, "unitsize",
+			NULL);
+	idx->num_samples = g_key_file_get_uint64(kf, INDEX_GROUP, "samples",
+			NULL);
+	idx->data_offset = g_key_file_get_uint64(kf, INDEX_GROUP,
+			"dataoffset", NULL);
+	idx->probe_names = g_key_file_get_string_list(kf, INDEX_GROUP,
+			"probes", NULL, NULL);
+	points = g_key_file_get_string_list(kf, INDEX_GROUP, "points", NULL,
+			NULL);
+	for (i = 0; points && points[i]; i++) {
+		if (point_parse(points[i], &pt) != SR_OK)
+			break;
+		g_array_append_val(idx->points, pt);
+	}
+	if (idx->type < 0 || idx->unitsize < 1 || !idx->probe_names
+			|| (points && points[i])
+			|| (idx->type == INDEX_TRANSITIONS && !idx->points->len)) {
+		g_debug("cli: Index %s is invalid.", path);
+		sample_index_free(idx);
+		idx = NULL;
+	}
+
+done:
+	g_strfreev(points);
+	g_free(kind);
+	g_key_file_free(kf);
+
+	return idx;
+}
+
+static void index_save(const char *path, const struct stat *st,
+		const struct sample_index *idx)
+{
+	const struct index_point *pt;
+	GKeyFile *kf;
+	GError *error;
+	GString *s;
+	char **points, *data;
+	gsize len;
+	guint i;
+	int j;
+
+	if (!(points = g_try_malloc0((idx->points->len + 1)
+			* sizeof(char *)))) {
+		g_critical("Index malloc failed.");
+		return;
+	}
+
+	kf = g_key_file_new();
+	g_key_file_set_string(kf, INDEX_GROUP, "kind", index_kinds[idx->type]);
+	g_key_file_set_uint64(kf, INDEX_GROUP, "filesize", st->st_size);
+	g_key_file_set_int64(kf, INDEX_GROUP, "mtime", st->st_mtime);
+	g_key_file_set_uint64(kf, INDEX_GROUP, "samplerate", idx->samplerate);
+	g_key_file_set_integer(kf, INDEX_GROUP, "unitsize", idx->unitsize);
+	g_key_file_set_uint64(kf, INDEX_GROUP, "samples", idx->num_samples);
+	g_key_file_set_uint64(kf, INDEX_GROUP, "dataoffset", idx->data_offset);
+	g_key_file_set_string_list(kf, INDEX_GROUP, "probes",
+			(const gchar * const *)idx->probe_names,
+			g_strv_length(idx->probe_names));
+
+	for (i = 0; i < idx->points->len; i++) {
+		pt = &g_array_index(idx->points, struct index_point, i);
+		s = g_string_sized_new(64);
+		g_string_printf(s, "%" PRIu64 ":%" PRIu64 ":", pt->sample,
+				pt->offset);
+		for (j = 0; j < idx->unitsize; j++)
+			g_string_append_printf(s, "%02x", pt->value[j]);
+		points[i] = g_string_free(s, FALSE);
+	}
+	g_key_file_set_string_list(kf, INDEX_GROUP, "points",
+			(const gchar * const *)points, i);
+	g_strfreev(points);
+
+	data = g_key_file_to_data(kf, &len, NULL);
+	error = NULL;
+	/* Not being able to write next to the file is fine, if slower. */
+	if (!g_file_set_contents(path, data, len, &error)) {
+		g_debug("cli: Failed to save index: %s.", error->message);
+		g_error_free(error);
+	}
+
+	g_free(data);
+	g_key_file_free(kf);
+}
+
+/**
+ * Get the index for a capture file, building it if there isn't an
+ * up-to-date one yet.
+ *
+ * @param filename The capture file.
+ *
+ * @return The index, to be freed with sample_index_free(), or NULL if the
+ *         file can't be indexed.
+ */
+struct sample_index *sample_index_get(const char *filename)
+{
+	struct sample_index *idx;
+	struct stat st;
+	char *path;
+	int ret;
+
+	if (g_stat(filename, &st) != 0 || !S_ISREG(st.st_mode))
+		return NULL;
+
+	path = g_strconcat(filename, ".idx", NULL);
+	if ((idx = index_load(path, &st))) {
+		g_debug("cli: Using index %s.", path);
+		g_free(path);
+		return idx;
+	}
+
+	if (!(idx = sample_index_new())) {
+		g_free(path);
+		return NULL;
+	}
+	if (transitions_match(filename))
+		ret = transitions_index(filename, idx);
+	else
+		ret = session_file_index(filename, idx);
+	if (ret != SR_OK) {
+		g_debug("cli: Can't index %s.", filename);
+		sample_index_free(idx);
+		g_free(path);
+		return NULL;
+	}
+
+	g_debug("cli: Indexed %" PRIu64 " samples, %u entry points.",
+			idx->num_samples, idx->points->len);
+	index_save(path, &st, idx);
+	g_free(path);
+
+	return idx;
+}
+
+/**
+ * Find where to start reading to get to a sample.
+ *
+ * @param idx The index.
+ * @param sample The sample.
+ *
+ * @return The last entry point at or before the sample, or NULL if the
+ *         index has none.
+ */
+const struct index_point *sample_index_find(const struct sample_index *idx,
+		uint64_t sample)
+{
+	const struct index_point *points;
+	guint lo, hi, mid;
+
+	if (!idx->points->len)
+		return NULL;
+
+	points = (const struct index_point *)idx->points->data;
+	lo = 0;
+	hi = idx->points->len;
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if (points[mid].sample <= sample)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return &points[lo];
+}
+
+void sample_index_free(struct sample_index *idx)
+{
+	if (!idx)
+		return;
+
+	g_array_free(idx->points, TRUE);
+	g_strfreev(idx->probe_names);
+	g_free(idx);
+}
@@ -0,0 +1,309 @@
+/*
+ * This file is part of the sigrok project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libsigrok/libsigrok.h>
+#include "sigrok-cli.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/*
+ * Raw logic samples are fed to the datafeed a chunk at a time, straight
+ * from the file, so output and decoding start right away and only a
+ * chunk or two of the file is ever held in memory.
+ */
+
+static void send_logic(const struct sr_dev_inst *sdi, sr_datafeed_callback_t cb,
+		const uint8_t *data, uint64_t len, int unitsize)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+
+	logic.length = len;
+	logic.unitsize = unitsize;
+	logic.data = (void *)data;
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	cb(sdi, &packet);
+}
+
+#ifdef HAVE_SYS_MMAN_H
+/*
+ * Map and send one window of the file at a time. Mappings must start on a
+ * page, so when the samples don't, a little more is mapped than is sent.
+ */
+static int stream_mmap(int fd, uint64_t start, uint64_t size,
+		uint64_t chunksize, const struct sr_dev_inst *sdi,
+		sr_datafeed_callback_t cb, int unitsize)
+{
+	uint64_t offset, len, skip, page;
+	uint8_t *p;
+
+	page = sysconf(_SC_PAGESIZE);
+	for (offset = start; offset < size; offset += len) {
+		len = MIN(chunksize, size - offset);
+		if ((len -= len % unitsize) == 0)
+			break;
+		skip = offset % page;
+		p = mmap(NULL, skip + len, PROT_READ, MAP_PRIVATE, fd,
+				offset - skip);
+		if (p == MAP_FAILED) {
+			g_critical("Failed to map input file: %s.",
+					strerror(errno));
+			return SR_ERR;
+		}
+#ifdef MADV_SEQUENTIAL
+		madvise(p, skip + len, MADV_SEQUENTIAL);
+#endif
+#ifdef HAVE_POSIX_FADVISE
+		/* Get the next window read in while this one is processed. */
+		if (offset + len < size)
+			posix_fadvise(fd, offset + len, chunksize,
+					POSIX_FADV_WILLNEED);
+#endif
+		send_logic(sdi, cb, p + skip, len, unitsize);
+		munmap(p, skip + len);
+	}
+
+	return SR_OK;
+}
+#endif
+
+static int stream_read(int fd, uint64_t start, uint64_t size,
+		uint64_t chunksize, const struct sr_dev_inst *sdi,
+		sr_datafeed_callback_t cb, int unitsize)
+{
+	uint8_t *buf;
+	uint64_t len, want;
+	ssize_t ret;
+
+	/* Pipes can't seek, so skip ahead the hard way. */
+	if (start && lseek(fd, start, SEEK_CUR) < 0) {
+		if (!(buf = g_try_malloc(chunksize))) {
+			g_critical("Input buffer malloc failed.");
+			return SR_ERR_MALLOC;
+		}
+		while (start > 0 && (ret = read(fd, buf,
+				MIN(chunksize, start))) != 0) {
+			if (ret < 0 && errno == EINTR)
+				continue;
+			if (ret < 0) {
+				g_critical("Failed to read input file: %s.",
+						strerror(errno));
+				g_free(buf);
+				return SR_ERR;
+			}
+			start -= ret;
+		}
+		g_free(buf);
+		if (start > 0) {
+			g_critical("Start is past the end of the file.");
+			return SR_ERR_ARG;
+		}
+	}
+
+	if (!(buf = g_try_malloc(chunksize))) {
+		g_critical("Input buffer malloc failed.");
+		return SR_ERR_MALLOC;
+	}
+
+	do {
+		/* Fill up the whole chunk, so packets stay sample-aligned. */
+		want = size ? MIN(chunksize, size) : chunksize;
+		len = 0;
+		while (len < want) {
+			ret = read(fd, buf + len, want - len);
+			if (ret < 0 && errno == EINTR)
+				continue;
+			if (ret < 0) {
+				g_critical("Failed to read input file: %s.",
+						strerror(errno));
+				g_free(buf);
+				return SR_ERR;
+			}
+			if (ret == 0)
+				break;
+			len += ret;
+		}
+		if (len >= (uint64_t)unitsize)
+			send_logic(sdi, cb, buf, len - len % unitsize, unitsize);
+		if (size && (size -= len) == 0)
+			break;
+	} while (len == want);
+
+	g_free(buf);
+
+	return SR_OK;
+}
+
+/**
+ * Stream a file of raw logic samples into a datafeed callback.
+ *
+ * @param filename The file to load.
+ * @param sdi The device instance describing the file's probes.
+ * @param samplerate The samplerate to report, or 0 if not known.
+ * @param chunksize Maximum size of each SR_DF_LOGIC packet, in bytes.
+ * @param offset Where in the file the samples to send start, in bytes.
+ * @param length How many bytes of samples to send, 0 for all of them.
+ * @param cb The datafeed callback to send packets to.
+ *
+ * @return SR_OK upon success, or an SR_ERR* code upon errors.
+ */
+int input_stream_run(const char *filename, const struct sr_dev_inst *sdi,
+		uint64_t samplerate, uint64_t chunksize, uint64_t offset,
+		uint64_t length, sr_datafeed_callback_t cb)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_header header;
+	struct sr_datafeed_meta_logic meta;
+	struct stat st;
+	uint64_t align;
+	int fd, num_probes, unitsize, ret;
+
+	num_probes = g_slist_length(sdi->probes);
+	unitsize = (num_probes + 7) / 8;
+	if (unitsize < 1) {
+		g_critical("Input has no probes.");
+		return SR_ERR_ARG;
+	}
+
+	/* Windows are made of whole pages, and of whole samples. */
+	align = unitsize;
+#ifdef HAVE_SYS_MMAN_H
+	align *= sysconf(_SC_PAGESIZE);
+#endif
+	chunksize -= chunksize % align;
+	if (chunksize == 0)
+		chunksize = align;
+
+	if ((fd = g_open(filename, O_RDONLY | O_BINARY, 0)) < 0) {
+		g_critical("Failed to open %s: %s.", filename, strerror(errno));
+		return SR_ERR;
+	}
+	if (fstat(fd, &st) < 0) {
+		g_critical("Failed to stat %s: %s.", filename, strerror(errno));
+		close(fd);
+		return SR_ERR;
+	}
+	if (S_ISREG(st.st_mode) && offset && offset >= (uint64_t)st.st_size) {
+		g_critical("Start is past the end of the file.");
+		close(fd);
+		return SR_ERR_ARG;
+	}
+	g_debug("cli: Streaming %s in chunks of %" PRIu64 " bytes.",
+			filename, chunksize);
+
+	packet.type = SR_DF_HEADER;
+	packet.payload = &header;
+	header.feed_version = 1;
+	gettimeofday(&header.starttime, NULL);
+	cb(sdi, &packet);
+
+	packet.type = SR_DF_META_LOGIC;
+	packet.payload = &meta;
+	meta.num_probes = num_probes;
+	meta.samplerate = samplerate;
+	cb(sdi, &packet);
+
+#ifdef HAVE_SYS_MMAN_H
+	if (S_ISREG(st.st_mode))
+		ret = stream_mmap(fd, offset, length ? MIN(offset + length,
+				(uint64_t)st.st_size) : (uint64_t)st.st_size,
+				chunksize, sdi, cb, unitsize);
+	else
+#endif
+		ret = stream_read(fd, offset, length, chunksize, sdi, cb,
+				unitsize);
+	close(fd);
+
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+	cb(sdi, &packet);
+
+	return ret;
+}
+
+/**
+ * Create a device instance for a file the CLI reads itself, with one
+ * logic probe per name.
+ *
+ * @param names The probe names.
+ * @param num_probes Number of probes.
+ *
+ * @return The device instance, to be freed with input_dev_free(), or NULL
+ *         upon errors.
+ */
+struct sr_dev_inst *input_dev_new(char **names, int num_probes)
+{
+	struct sr_dev_inst *sdi;
+	struct sr_probe *probe;
+	int i;
+
+	if (!(sdi = g_try_malloc0(sizeof(struct sr_dev_inst)))) {
+		g_critical("Device instance malloc failed.");
+		return NULL;
+	}
+	sdi->status = SR_ST_ACTIVE;
+	for (i = 0; i < num_probes; i++) {
+		if (!(probe = g_try_malloc0(sizeof(struct sr_probe)))) {
+			g_critical("Probe malloc failed.");
+			input_dev_free(sdi);
+			return NULL;
+		}
+		probe->index = i;
+		probe->type = SR_PROBE_LOGIC;
+		probe->enabled = TRUE;
+		probe->name = g_strdup(names[i]);
+		sdi->probes = g_slist_append(sdi->probes, probe);
+	}
+
+	return sdi;
+}
+
+void input_dev_free(struct sr_dev_inst *sdi)
+{
+	struct sr_probe *probe;
+	GSList *l;
+
+	for (l = sdi->probes; l; l = l->next) {
+		probe = l->data;
+		g_free(probe->name);
+		g_free(probe->trigger);
+		g_free(probe);
+	}
+	g_slist_free(sdi->probes);
+	g_free(sdi);
+}
@@ -0,0 +1,360 @@
+/*
+ * This file is part of the sigrok project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "sigrok-cli.h"
+
+/*
+ * With --logic-stats, logic samples aren't output. Instead, each probe's
+ * transitions are counted, along with how long it was high and the
+ * shortest and longest pulse, and a summary is printed at the end, or
+ * after every so many samples.
+ *
+ * Everything follows from where the transitions are. XORing each sample
+ * with the one before it leaves a bit set for every probe which changed,
+ * and when a sample is 1, 2, 4 or 8 bytes, a 64-bit word of samples is
+ * XORed with itself shifted by one sample at once. Words with no
+ * transitions cost just that; in the others, each set bit is picked out
+ * with a count-trailing-zeros.
+ */
+
+#define NO_EDGE UINT64_MAX
+
+struct probe_stats {
+	uint64_t transitions;
+	/* Samples spent high. */
+	uint64_t high;
+	/* Up to where high has been counted. */
+	uint64_t since;
+	/* First and last transition, and the pulses in between. */
+	uint64_t first;
+	uint64_t last;
+	uint64_t min;
+	uint64_t max;
+};
+
+struct logic_stats {
+	int num_probes;
+	int unitsize;
+	char **probe_names;
+	uint64_t samplerate;
+	uint64_t interval;
+	/* Samples so far, and where the current summary started. */
+	uint64_t samples;
+	uint64_t start;
+	/* The last sample, which is also every probe's level. */
+	uint64_t prev;
+	gboolean started;
+	struct probe_stats *probes;
+};
+
+static void probes_reset(struct logic_stats *ls)
+{
+	struct probe_stats *ps;
+	int p;
+
+	/* The last transition is kept: a pulse going on across summaries
+	 * still counts. */
+	for (p = 0; p < ls->num_probes; p++) {
+		ps = &ls->probes[p];
+		ps->transitions = 0;
+		ps->high = 0;
+		ps->since = ls->samples;
+		ps->first = NO_EDGE;
+		ps->min = NO_EDGE;
+		ps->max = 0;
+	}
+}
+
+/**
+ * Set up logic statistics.
+ *
+ * @param probe_names Names of the probes, in the order of their bits in
+ *                    the samples. NULL-terminated.
+ * @param unitsize Size of a sample, in bytes.
+ * @param samplerate The samplerate, to show times and frequencies, or 0
+ *                   if it's not known.
+ * @param interval Number of samples each summary covers, or 0 for one at
+ *                 the end.
+ *
+ * @return The statistics, or NULL upon errors.
+ */
+struct logic_stats *logic_stats_new(char **probe_names, int unitsize,
+		uint64_t samplerate, uint64_t interval)
+{
+	struct logic_stats *ls;
+	int p;
+
+	if (unitsize < 1 || unitsize > 8) {
+		g_critical("Can't keep statistics for %d-byte samples.",
+				unitsize);
+		return NULL;
+	}
+	if (!(ls = g_try_malloc0(sizeof(struct logic_stats)))) {
+		g_critical("Logic statistics malloc failed.");
+		return NULL;
+	}
+	ls->num_probes = g_strv_length(probe_names);
+	ls->unitsize = unitsize;
+	ls->probe_names = g_strdupv(probe_names);
+	ls->samplerate = samplerate;
+	ls->interval = interval;
+	if (!(ls->probes = g_try_malloc(MAX(ls->num_probes, 1)
+			* sizeof(struct probe_stats)))) {
+		g_critical("Logic statistics malloc failed.");
+		logic_stats_destroy(ls);
+		return NULL;
+	}
+	for (p = 0; p < ls->num_probes; p++)
+		ls->probes[p].last = NO_EDGE;
+	probes_reset(ls);
+
+	return ls;
+}
+
+/* A sample, with probe n in bit n. */
+static inline uint64_t sample_get(const uint8_t *p, int unitsize)
+{
+	uint64_t w;
+	int b;
+
+	w = 0;
+	for (b = 0; b < unitsize; b++)
+		w |= (uint64_t)p[b] << (b * 8);
+
+	return w;
+}
+
+static inline void edge(struct logic_stats *ls, int p, uint64_t at)
+{
+	struct probe_stats *ps;
+	uint64_t width;
+
+	if (p >= ls->num_probes)
+		return;
+
+	ps = &ls->probes[p];
+	if ((ls->prev >> p) & 1)
+		ps->high += at - ps->since;
+	ps->since = at;
+	if (ps->last != NO_EDGE) {
+		width = at - ps->last;
+		ps->min = MIN(ps->min, width);
+		ps->max = MAX(ps->max, width);
+	}
+	if (ps->first == NO_EDGE)
+		ps->first = at;
+	ps->last = at;
+	ps->transitions++;
+	/* The level changes, for the next transition to go by. */
+	ls->prev ^= (uint64_t)1 << p;
+}
+
+/* Every transition in x, with bit b in sample base + b / bits. */
+static inline void edges(struct logic_stats *ls, uint64_t x, uint64_t base,
+		int bits)
+{
+	int b;
+
+	while (x) {
+		b = __builtin_ctzll(x);
+		edge(ls, b % bits, base + b / bits);
+		x &= x - 1;
+	}
+}
+
+static void count(struct logic_stats *ls, const uint8_t *data,
+		uint64_t num_samples)
+{
+	uint64_t i, w, s, x, spw;
+	int u, bits;
+
+	u = ls->unitsize;
+	bits = u * 8;
+	i = 0;
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+	if (8 % u == 0) {
+		spw = 8 / u;
+		for (; i + spw <= num_samples; i += spw) {
+			memcpy(&w, data + i * u, 8);
+			/* Each sample lined up with the one before it. */
+			s = bits == 64 ? ls->prev : w << bits | ls->prev;
+			if (!(x = w ^ s))
+				continue;
+			edges(ls, x, ls->samples + i, bits);
+			/* ls->prev now matches the last sample. */
+		}
+	}
+#endif
+	for (; i < num_samples; i++) {
+		w = sample_get(data + i * u, u);
+		if ((x = w ^ ls->prev))
+			edges(ls, x, ls->samples + i, bits);
+	}
+	ls->samples += num_samples;
+}
+
+static void append_time(GString *s, double t)
+{
+	if (t >= 1)
+		g_string_append_printf(s, "%.4g s", t);
+	else if (t >= 1e-3)
+		g_string_append_printf(s, "%.4g ms", t * 1e3);
+	else if (t >= 1e-6)
+		g_string_append_printf(s, "%.4g us", t * 1e6);
+	else
+		g_string_append_printf(s, "%.4g ns", t * 1e9);
+}
+
+static void append_freq(GString *s, double f)
+{
+	if (f >= 1e9)
+		g_string_append_printf(s, "%.6g GHz", f / 1e9);
+	else if (f >= 1e6)
+		g_string_append_printf(s, "%.6g MHz", f / 1e6);
+	else if (f >= 1e3)
+		g_string_append_printf(s, "%.6g kHz", f / 1e3);
+	else
+		g_string_append_printf(s, "%.6g Hz", f);
+}
+
+/* Print the summary so far, and start the next one. */
+static void summary(struct logic_stats *ls, GString *s)
+{
+	struct probe_stats *ps;
+	uint64_t len;
+	int p;
+
+	len = ls->samples - ls->start;
+	g_string_append_printf(s, "Samples %" PRIu64 "-%" PRIu64 ":\n",
+			ls->start, ls->samples - 1);
+	for (p = 0; p < ls->num_probes; p++) {
+		ps = &ls->probes[p];
+		if ((ls->prev >> p) & 1)
+			ps->high += ls->samples - ps->since;
+		g_string_append_printf(s, "%s: %" PRIu64 " transitions, "
+				"%.2f%% high", ls->probe_names[p],
+				ps->transitions, 100.0 * ps->high / len);
+		if (ps->max && ls->samplerate) {
+			g_string_append(s, ", pulses ");
+			append_time(s, (double)ps->min / ls->samplerate);
+			g_string_append(s, " to ");
+			append_time(s, (double)ps->max / ls->samplerate);
+		} else if (ps->max) {
+			g_string_append_printf(s, ", pulses %" PRIu64 " to %"
+					PRIu64 " samples", ps->min, ps->max);
+		}
+		/* Two transitions make a period. */
+		if (ps->transitions > 1 && ls->samplerate) {
+			g_string_append(s, ", ");
+			append_freq(s, (double)(ps->transitions - 1)
+					* ls->samplerate
+					/ (2.0 * (ps->last - ps->first)));
+		}
+		g_string_append_c(s, '\n');
+	}
+
+	ls->start = ls->samples;
+	probes_reset(ls);
+}
+
+static uint64_t summary_out(GString *s, uint8_t **out)
+{
+	uint64_t len;
+
+	if (!(len = s->len)) {
+		g_string_free(s, TRUE);
+		*out = NULL;
+		return 0;
+	}
+	*out = (uint8_t *)g_string_free(s, FALSE);
+
+	return len;
+}
+
+/**
+ * Add logic samples to the statistics.
+ *
+ * @param ls The statistics.
+ * @param data The samples.
+ * @param len Length of the samples, in bytes.
+ * @param out Set to the summaries completed, to be freed with g_free(), or
+ *            NULL if there are none.
+ *
+ * @return Length of the summaries, in bytes.
+ */
+uint64_t logic_stats_run(struct logic_stats *ls, const uint8_t *data,
+		uint64_t len, uint8_t **out)
+{
+	GString *s;
+	uint64_t num_samples, i, n;
+
+	s = g_string_sized_new(256);
+	num_samples = len / ls->unitsize;
+	if (num_samples && !ls->started) {
+		/* The first sample has nothing to change from. */
+		ls->prev = sample_get(data, ls->unitsize);
+		ls->started = TRUE;
+	}
+	for (i = 0; i < num_samples; i += n) {
+		n = num_samples - i;
+		if (ls->interval)
+			n = MIN(n, ls->start + ls->interval - ls->samples);
+		count(ls, data + i * ls->unitsize, n);
+		if (ls->interval && ls->samples - ls->start == ls->interval)
+			summary(ls, s);
+	}
+
+	return summary_out(s, out);
+}
+
+/**
+ * Get the summary of the samples since the last one.
+ *
+ * @param ls The statistics.
+ * @param out Set to the summary, to be freed with g_free(), or NULL if
+ *            there have been no samples since the last one.
+ *
+ * @return Length of the summary, in bytes.
+ */
+uint64_t logic_stats_flush(struct logic_stats *ls, uint8_t **out)
+{
+	GString *s;
+
+	s = g_string_sized_new(256);
+	if (ls->samples > ls->start)
+		summary(ls, s);
+
+	return summary_out(s, out);
+}
+
+void logic_stats_destroy(struct logic_stats *ls)
+{
+	if (!ls)
+		return;
+
+	g_strfreev(ls->probe_names);
+	g_free(ls->probes);
+	g_free(ls);
+}
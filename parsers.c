@@ -207,3 +207,173 @@ int canon_cmp(const char *str1, const char *str2)
 
 	return ret;
 }
+
+/**
+ * Parse the --flush option.
+ *
+ * Accepts "packet", "end", "size=<size>" or "time=<time>", where size is
+ * a number of bytes (k/m/g suffixes allowed) and time is in milliseconds
+ * (or seconds, with an "s" suffix).
+ *
+ * @param str The option string.
+ * @param mode Will be set to one of the FLUSH_* modes.
+ * @param arg Will be set to the size or time interval, if any.
+ *
+ * @return SR_OK upon success, SR_ERR upon an invalid policy.
+ */
+int parse_flush_policy(const char *str, int *mode, uint64_t *arg)
+{
+	*arg = 0;
+	if (!strcmp(str, "packet")) {
+		*mode = FLUSH_PACKET;
+	} else if (!strcmp(str, "end")) {
+		*mode = FLUSH_END;
+	} else if (!strncmp(str, "size=", 5)) {
+		*mode = FLUSH_SIZE;
+		if (sr_parse_sizestring(str + 5, arg) != SR_OK)
+			*arg = 0;
+	} else if (!strncmp(str, "time=", 5)) {
+		*mode = FLUSH_TIME;
+		*arg = sr_parse_timestring(str + 5);
+	} else {
+		g_critical("Invalid flush policy '%s'.", str);
+		return SR_ERR;
+	}
+
+	if ((*mode == FLUSH_SIZE || *mode == FLUSH_TIME) && *arg == 0) {
+		g_critical("Invalid flush policy '%s'.", str);
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Parse a position in a capture, given either as a sample number (k/m/g
+ * suffixes allowed) or as a time from the start of the capture, with a
+ * "s" or "ms" suffix.
+ *
+ * @param str The position.
+ * @param samplerate The capture's samplerate, needed for times.
+ * @param sample Will be set to the number of the sample at the position.
+ *
+ * @return SR_OK upon success, SR_ERR upon an invalid position.
+ */
+int parse_sample_pos(const char *str, uint64_t samplerate, uint64_t *sample)
+{
+	size_t len;
+	uint64_t ms;
+
+	len = strlen(str);
+	if (len == 0 || g_ascii_tolower(str[len - 1]) != 's') {
+		if (sr_parse_sizestring(str, sample) != SR_OK) {
+			g_critical("Invalid sample position '%s'.", str);
+			return SR_ERR;
+		}
+		return SR_OK;
+	}
+
+	/* "0s" is fine, but it's also what the time parser returns
+	 * upon errors. */
+	if (!(ms = sr_parse_timestring(str)) && str[0] != '0') {
+		g_critical("Invalid time '%s'.", str);
+		return SR_ERR;
+	}
+	if (!samplerate) {
+		g_critical("Position '%s' is a time, but the samplerate "
+				"isn't known.", str);
+		return SR_ERR;
+	}
+	*sample = ms * samplerate / 1000;
+
+	return SR_OK;
+}
+
+/**
+ * Parse the --analog-threshold option.
+ *
+ * Accepts a comma-separated list of "<level>[:<hysteresis>]", each of which
+ * may be preceded by "<probe>=" to only apply to that probe. A level without
+ * a probe name applies to all probes which aren't named.
+ *
+ * @param str The option string.
+ * @param probe_names The analog probes, NULL-terminated. If NULL, the
+ *                    string is only checked.
+ * @param levels Will be set to the level of each probe.
+ * @param hysteresis Will be set to the hysteresis of each probe.
+ *
+ * @return SR_OK upon success, SR_ERR upon an invalid string, or if not
+ *         every probe gets a level.
+ */
+int parse_thresholds(const char *str, char **probe_names, float *levels,
+		float *hysteresis)
+{
+	gboolean named[SR_MAX_NUM_PROBES], set[SR_MAX_NUM_PROBES];
+	char **tokens, *tok, *name, *end;
+	float level, hyst;
+	int ret, num_probes, i, j;
+
+	num_probes = probe_names ? (int)g_strv_length(probe_names) : 0;
+	for (i = 0; i < num_probes; i++)
+		named[i] = set[i] = FALSE;
+
+	ret = SR_OK;
+	tokens = g_strsplit(str, ",", 0);
+	for (j = 0; tokens[j]; j++) {
+		tok = tokens[j];
+		name = NULL;
+		if ((end = strchr(tok, '='))) {
+			*end = '\0';
+			name = tok;
+			tok = end + 1;
+		}
+		level = g_ascii_strtod(tok, &end);
+		hyst = 0;
+		if (end != tok && *end == ':') {
+			tok = end + 1;
+			hyst = g_ascii_strtod(tok, &end);
+		}
+		if (end == tok || *end || hyst < 0) {
+			g_critical("Invalid analog threshold '%s'.", str);
+			ret = SR_ERR;
+			break;
+		}
+
+		if (!name) {
+			for (i = 0; i < num_probes; i++) {
+				if (named[i])
+					continue;
+				levels[i] = level;
+				hysteresis[i] = hyst;
+				set[i] = TRUE;
+			}
+			continue;
+		}
+		if (!probe_names)
+			continue;
+		for (i = 0; i < num_probes; i++) {
+			if (!strcmp(probe_names[i], name))
+				break;
+		}
+		if (i == num_probes) {
+			g_critical("Analog threshold for unknown probe '%s'.",
+					name);
+			ret = SR_ERR;
+			break;
+		}
+		levels[i] = level;
+		hysteresis[i] = hyst;
+		named[i] = set[i] = TRUE;
+	}
+	g_strfreev(tokens);
+
+	for (i = 0; ret == SR_OK && i < num_probes; i++) {
+		if (!set[i]) {
+			g_critical("No analog threshold for probe '%s'.",
+					probe_names[i]);
+			ret = SR_ERR;
+		}
+	}
+
+	return ret;
+}
@@ -0,0 +1,747 @@
+/*
+ * This file is part of the sigrok project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <sigrokdecode.h> /* First, so we avoid a _POSIX_C_SOURCE warning. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "sigrok-cli.h"
+
+#if defined(HAVE_FORK) && defined(HAVE_SYS_MMAN_H)
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#define HAVE_PD_FARM 1
+#endif
+
+/*
+ * Independent protocol decoders (or decoder stacks) don't need to share
+ * a Python interpreter, so each can be run in a worker process of its
+ * own. The samples are copied into a ring in shared memory once, and
+ * every worker is told where to find each block through a pipe. The
+ * workers send their annotations back through another pipe, followed by
+ * a marker when they're done with a block.
+ *
+ * Annotations are printed block by block, and within a block in worker
+ * order, which is the same order a single interpreter would produce them
+ * in. A block's space in the ring is reused once every worker is done
+ * with it.
+ */
+
+#ifdef HAVE_PD_FARM
+
+#define RING_SIZE (32 * 1024 * 1024)
+/* No single block takes up more of the ring than this. */
+#define MAX_BLOCK_SIZE (RING_SIZE / 4)
+/* Blocks sent but not yet finished by every worker. */
+#define MAX_INFLIGHT 256
+
+enum {
+	CMD_START,
+	CMD_DATA,
+	CMD_END,
+};
+
+struct farm_cmd {
+	uint32_t type;
+	int32_t num_probes;
+	int32_t unitsize;
+	uint32_t pad;
+	/* Samplerate for CMD_START, first sample number for CMD_DATA. */
+	uint64_t arg;
+	uint64_t offset;
+	uint64_t len;
+};
+
+enum {
+	REC_READY,
+	REC_ANN,
+	REC_DONE,
+	REC_ERROR,
+};
+
+struct farm_rec {
+	uint32_t type;
+	uint32_t len;
+};
+
+struct farm_worker {
+	pid_t pid;
+	int cmd_fd;
+	int res_fd;
+	/* Received from the worker, not yet printed. */
+	GString *rbuf;
+	gsize rpos;
+	gboolean eof;
+};
+
+struct pd_farm {
+	struct farm_worker *workers;
+	int num_workers;
+	uint8_t *ring;
+	/* Ring positions, counted in bytes ever written. */
+	uint64_t head;
+	uint64_t tail;
+	uint64_t block_end[MAX_INFLIGHT];
+	/* Blocks sent, and blocks every worker is done with. */
+	uint64_t seq;
+	uint64_t out_seq;
+	int out_worker;
+	int unitsize;
+	gboolean failed;
+	pd_farm_ann_cb ann_cb;
+};
+
+static struct pd_farm *farm = NULL;
+
+/* Worker side. */
+static int worker_res_fd = -1;
+static GString *worker_wbuf = NULL;
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const uint8_t *p;
+	ssize_t ret;
+
+	p = buf;
+	while (len > 0) {
+		ret = write(fd, p, len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0)
+			return SR_ERR;
+		p += ret;
+		len -= ret;
+	}
+
+	return SR_OK;
+}
+
+/* Returns SR_OK, or SR_ERR on EOF or error. */
+static int read_all(int fd, void *buf, size_t len)
+{
+	uint8_t *p;
+	ssize_t ret;
+
+	p = buf;
+	while (len > 0) {
+		ret = read(fd, p, len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return SR_ERR;
+		p += ret;
+		len -= ret;
+	}
+
+	return SR_OK;
+}
+
+static void worker_rec(uint32_t type, const char *data, uint32_t len)
+{
+	struct farm_rec rec;
+
+	rec.type = type;
+	rec.len = len;
+	g_string_append_len(worker_wbuf, (const gchar *)&rec, sizeof(rec));
+	if (len)
+		g_string_append_len(worker_wbuf, data, len);
+}
+
+static int worker_flush(void)
+{
+	int ret;
+
+	ret = write_all(worker_res_fd, worker_wbuf->str, worker_wbuf->len);
+	g_string_truncate(worker_wbuf, 0);
+
+	return ret;
+}
+
+static void worker_run(int cmd_fd, const uint8_t *ring)
+{
+	struct farm_cmd cmd;
+	gboolean failed;
+	int ret;
+
+	failed = FALSE;
+	while (read_all(cmd_fd, &cmd, sizeof(cmd)) == SR_OK) {
+		ret = SRD_OK;
+		if (failed)
+			;
+		else if (cmd.type == CMD_START)
+			ret = srd_session_start(cmd.num_probes, cmd.unitsize,
+					cmd.arg);
+		else if (cmd.type == CMD_DATA)
+			ret = srd_session_send(cmd.arg,
+					(uint8_t *)ring + cmd.offset, cmd.len);
+		if (ret != SRD_OK) {
+			worker_rec(REC_ERROR, NULL, 0);
+			failed = TRUE;
+		}
+		worker_rec(REC_DONE, NULL, 0);
+		if (worker_flush() != SR_OK)
+			break;
+	}
+}
+
+/**
+ * Pass an annotation from a worker process back to sigrok-cli.
+ *
+ * @param line The formatted annotation.
+ * @param len Length of the annotation, in bytes.
+ */
+void pd_farm_annotation(const char *line, gsize len)
+{
+	worker_rec(REC_ANN, line, len);
+	/* Don't let the buffer grow without bounds on a chatty decoder. */
+	if (worker_wbuf->len >= 64 * 1024)
+		worker_flush();
+}
+
+static void worker_eof(struct farm_worker *w)
+{
+	if (!w->eof)
+		g_critical("Protocol decoder worker %d exited unexpectedly.",
+				(int)w->pid);
+	w->eof = TRUE;
+	farm->failed = TRUE;
+}
+
+/* Whether any worker is still running. */
+static gboolean farm_live(void)
+{
+	int i;
+
+	for (i = 0; i < farm->num_workers; i++)
+		if (!farm->workers[i].eof)
+			return TRUE;
+
+	return FALSE;
+}
+
+/* Print whatever can be printed in order, and release the ring space. */
+static void merge(void)
+{
+	struct farm_worker *w;
+	struct farm_rec rec;
+	gsize avail;
+	gboolean done;
+
+	while (farm->out_seq < farm->seq) {
+		w = &farm->workers[farm->out_worker];
+		done = FALSE;
+		avail = w->rbuf->len - w->rpos;
+		if (avail >= sizeof(rec))
+			memcpy(&rec, w->rbuf->str + w->rpos, sizeof(rec));
+		if (avail >= sizeof(rec) && avail - sizeof(rec) >= rec.len) {
+			w->rpos += sizeof(rec);
+			if (rec.type == REC_ANN)
+				farm->ann_cb(w->rbuf->str + w->rpos, rec.len);
+			else if (rec.type == REC_ERROR)
+				farm->failed = TRUE;
+			else if (rec.type == REC_DONE)
+				done = TRUE;
+			w->rpos += rec.len;
+		} else if (w->eof) {
+			/*
+			 * Nothing more coming from this one. Drop whatever's
+			 * left of a record it died in the middle of.
+			 */
+			w->rpos = w->rbuf->len;
+			done = TRUE;
+		} else {
+			break;
+		}
+		if (!done)
+			continue;
+		if (++farm->out_worker == farm->num_workers) {
+			farm->out_worker = 0;
+			farm->tail = farm->block_end[farm->out_seq % MAX_INFLIGHT];
+			farm->out_seq++;
+		}
+	}
+}
+
+/*
+ * Read what the workers have sent, waiting for at most timeout ms
+ * (-1 to wait until something comes in).
+ */
+static void farm_read(int timeout)
+{
+	struct pollfd *fds;
+	struct farm_worker *w;
+	gsize len;
+	ssize_t ret;
+	int i, n;
+
+	fds = g_alloca(farm->num_workers * sizeof(struct pollfd));
+	for (i = n = 0; i < farm->num_workers; i++) {
+		if (farm->workers[i].eof)
+			continue;
+		fds[n].fd = farm->workers[i].res_fd;
+		fds[n].events = POLLIN;
+		n++;
+	}
+	if (n == 0 || poll(fds, n, timeout) <= 0) {
+		merge();
+		return;
+	}
+
+	for (i = n = 0; i < farm->num_workers; i++) {
+		w = &farm->workers[i];
+		if (w->eof)
+			continue;
+		if (!(fds[n++].revents & (POLLIN | POLLHUP | POLLERR)))
+			continue;
+		/* Drop what's already been printed. */
+		if (w->rpos) {
+			g_string_erase(w->rbuf, 0, w->rpos);
+			w->rpos = 0;
+		}
+		len = w->rbuf->len;
+		g_string_set_size(w->rbuf, len + 65536);
+		ret = read(w->res_fd, w->rbuf->str + len, 65536);
+		g_string_set_size(w->rbuf, len + MAX(ret, 0));
+		if (ret == 0 || (ret < 0 && errno != EINTR && errno != EAGAIN))
+			worker_eof(w);
+	}
+
+	merge();
+}
+
+static void send_cmd(const struct farm_cmd *cmd)
+{
+	int i;
+
+	for (i = 0; i < farm->num_workers; i++) {
+		if (farm->workers[i].eof)
+			continue;
+		if (write_all(farm->workers[i].cmd_fd, cmd, sizeof(*cmd)) != SR_OK)
+			worker_eof(&farm->workers[i]);
+	}
+	farm->block_end[farm->seq % MAX_INFLIGHT] = farm->head;
+	farm->seq++;
+}
+
+/* Wait until a block of len bytes fits in the ring, and reserve it. */
+static int ring_reserve(uint64_t len, uint64_t *offset)
+{
+	uint64_t off, skip;
+
+	for (;;) {
+		off = farm->head % RING_SIZE;
+		skip = (off + len > RING_SIZE) ? RING_SIZE - off : 0;
+		if (farm->head + skip + len - farm->tail <= RING_SIZE
+				&& farm->seq - farm->out_seq < MAX_INFLIGHT)
+			break;
+		if (farm->failed)
+			return SR_ERR;
+		farm_read(-1);
+	}
+	farm->head += skip;
+	*offset = farm->head % RING_SIZE;
+	farm->head += len;
+
+	return SR_OK;
+}
+
+/*
+ * Split the decoders up into independently running groups. The index of
+ * the group holding the -s stack is stored in stack_idx, or -1.
+ */
+static GPtrArray *pd_groups(const char *pds, const char *stack,
+		int *stack_idx)
+{
+	GPtrArray *groups;
+	GString *stack_group;
+	char **tokens, **names, name[64];
+	int i, j;
+	gboolean stacked;
+
+	groups = g_ptr_array_new();
+	*stack_idx = -1;
+	tokens = g_strsplit(pds, ",", 0);
+	if (g_strv_length(tokens) > 1 && !stack) {
+		/* Without -s, all decoders go on one stack. */
+		g_ptr_array_add(groups, g_string_new(pds));
+		g_strfreev(tokens);
+		return groups;
+	}
+
+	names = g_strsplit(stack ? stack : "", ",", 0);
+	for (i = 0; names[i]; i++) {
+		if (strchr(names[i], ':'))
+			*strchr(names[i], ':') = '\0';
+	}
+	stack_group = NULL;
+	for (i = 0; tokens[i]; i++) {
+		g_strlcpy(name, tokens[i], sizeof(name));
+		if (strchr(name, ':'))
+			*strchr(name, ':') = '\0';
+		stacked = FALSE;
+		for (j = 0; names[j]; j++) {
+			if (!strcmp(names[j], name))
+				stacked = TRUE;
+		}
+		if (!stacked) {
+			g_ptr_array_add(groups, g_string_new(tokens[i]));
+		} else if (!stack_group) {
+			stack_group = g_string_new(tokens[i]);
+			*stack_idx = groups->len;
+			g_ptr_array_add(groups, stack_group);
+		} else {
+			g_string_append_printf(stack_group, ",%s", tokens[i]);
+		}
+	}
+	g_strfreev(names);
+	g_strfreev(tokens);
+
+	return groups;
+}
+
+static void farm_free(void)
+{
+	int i;
+
+	for (i = 0; i < farm->num_workers; i++) {
+		if (farm->workers[i].cmd_fd >= 0)
+			close(farm->workers[i].cmd_fd);
+		if (farm->workers[i].res_fd >= 0)
+			close(farm->workers[i].res_fd);
+		if (farm->workers[i].pid > 0)
+			waitpid(farm->workers[i].pid, NULL, 0);
+		if (farm->workers[i].rbuf)
+			g_string_free(farm->workers[i].rbuf, TRUE);
+	}
+	munmap(farm->ring, RING_SIZE);
+	g_free(farm->workers);
+	g_free(farm);
+	farm = NULL;
+}
+
+/**
+ * Start worker processes for independent protocol decoders.
+ *
+ * This has to be called before any other threads are started. In the
+ * worker processes, the function doesn't return.
+ *
+ * @param pds The protocol decoders, as given with -a.
+ * @param stack The protocol decoder stack, as given with -s, or NULL.
+ * @param jobs The maximum number of worker processes.
+ * @param setup Sets up the given decoders in a worker. It gets passed the
+ *              stack only if the worker runs the stacked decoders.
+ * @param ann_cb Prints an annotation from a worker.
+ *
+ * @return The number of workers started, 0 if the decoders can't be
+ *         split up, or a negative SR_ERR* code upon errors.
+ */
+int pd_farm_start(const char *pds, const char *stack, int jobs,
+		pd_farm_setup_cb setup, pd_farm_ann_cb ann_cb)
+{
+	struct farm_worker *w;
+	struct farm_rec rec;
+	GPtrArray *groups;
+	GString **wpds, *g;
+	int cmd_pipe[2], res_pipe[2], ret, num_groups, stack_idx, stack_worker;
+	int i, j;
+
+	groups = pd_groups(pds, stack, &stack_idx);
+	num_groups = groups->len;
+	if (num_groups < 2 || jobs < 2) {
+		g_debug("cli: Not enough independent protocol decoders "
+				"for worker processes.");
+		for (i = 0; i < num_groups; i++)
+			g_string_free(g_ptr_array_index(groups, i), TRUE);
+		g_ptr_array_free(groups, TRUE);
+		return 0;
+	}
+
+	/*
+	 * Each worker gets a run of consecutive groups, so worker order
+	 * followed by the order within each worker is still the order the
+	 * decoders were given in.
+	 */
+	jobs = MIN(jobs, num_groups);
+	wpds = g_alloca(jobs * sizeof(GString *));
+	memset(wpds, 0, jobs * sizeof(GString *));
+	for (i = 0; i < num_groups; i++) {
+		g = g_ptr_array_index(groups, i);
+		j = i * jobs / num_groups;
+		if (!wpds[j])
+			wpds[j] = g;
+		else {
+			g_string_append_printf(wpds[j], ",%s", g->str);
+			g_string_free(g, TRUE);
+		}
+	}
+	g_ptr_array_free(groups, TRUE);
+	stack_worker = stack_idx >= 0 ? stack_idx * jobs / num_groups : -1;
+
+	if (!(farm = g_try_malloc0(sizeof(struct pd_farm)))
+			|| !(farm->workers = g_try_malloc0(jobs * sizeof(struct farm_worker)))) {
+		g_critical("Protocol decoder farm malloc failed.");
+		g_free(farm);
+		farm = NULL;
+		return SR_ERR_MALLOC;
+	}
+	farm->ann_cb = ann_cb;
+	farm->ring = mmap(NULL, RING_SIZE, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (farm->ring == MAP_FAILED) {
+		g_critical("Failed to map protocol decoder ring: %s.",
+				strerror(errno));
+		g_free(farm->workers);
+		g_free(farm);
+		farm = NULL;
+		return SR_ERR;
+	}
+	for (i = 0; i < jobs; i++)
+		farm->workers[i].cmd_fd = farm->workers[i].res_fd = -1;
+
+	/* A worker that went away shows up as EOF, not as a signal. */
+	signal(SIGPIPE, SIG_IGN);
+
+	ret = SR_OK;
+	for (i = 0; i < jobs && ret == SR_OK; i++) {
+		w = &farm->workers[i];
+		farm->num_workers++;
+		if (pipe(cmd_pipe) < 0) {
+			ret = SR_ERR;
+			break;
+		}
+		if (pipe(res_pipe) < 0) {
+			close(cmd_pipe[0]);
+			close(cmd_pipe[1]);
+			ret = SR_ERR;
+			break;
+		}
+		fflush(NULL);
+		if ((w->pid = fork()) < 0) {
+			g_critical("Failed to start protocol decoder worker: %s.",
+					strerror(errno));
+			close(cmd_pipe[0]);
+			close(cmd_pipe[1]);
+			close(res_pipe[0]);
+			close(res_pipe[1]);
+			ret = SR_ERR;
+			break;
+		}
+		if (w->pid == 0) {
+			/* Worker process. */
+			for (j = 0; j < i; j++) {
+				close(farm->workers[j].cmd_fd);
+				close(farm->workers[j].res_fd);
+			}
+			close(cmd_pipe[1]);
+			close(res_pipe[0]);
+			worker_res_fd = res_pipe[1];
+			worker_wbuf = g_string_sized_new(65536);
+			g_debug("cli: Protocol decoder worker %d: %s.",
+					(int)getpid(), wpds[i]->str);
+			if (setup(wpds[i]->str,
+					stack_worker == i ? stack : NULL) != 0)
+				exit(1);
+			worker_rec(REC_READY, NULL, 0);
+			if (worker_flush() == SR_OK)
+				worker_run(cmd_pipe[0], farm->ring);
+			srd_exit();
+			exit(0);
+		}
+		close(cmd_pipe[0]);
+		close(res_pipe[1]);
+		w->cmd_fd = cmd_pipe[1];
+		w->res_fd = res_pipe[0];
+		w->rbuf = g_string_sized_new(65536);
+	}
+	for (i = 0; i < jobs; i++)
+		g_string_free(wpds[i], TRUE);
+
+	/* Wait for every worker to have its decoders set up. */
+	for (i = 0; i < farm->num_workers && ret == SR_OK; i++) {
+		if (read_all(farm->workers[i].res_fd, &rec, sizeof(rec)) != SR_OK
+				|| rec.type != REC_READY) {
+			g_critical("Protocol decoder worker failed to start.");
+			ret = SR_ERR;
+		}
+	}
+	if (ret != SR_OK) {
+		farm_free();
+		return ret;
+	}
+	g_debug("cli: Started %d protocol decoder workers.", farm->num_workers);
+
+	return farm->num_workers;
+}
+
+/**
+ * Start a protocol decoder session in all workers.
+ *
+ * @param num_probes Number of probes in the samples.
+ * @param unitsize Size of one sample, in bytes.
+ * @param samplerate The samplerate.
+ *
+ * @return SR_OK upon success, or an SR_ERR* code upon errors.
+ */
+int pd_farm_session_start(int num_probes, int unitsize, uint64_t samplerate)
+{
+	struct farm_cmd cmd;
+
+	memset(&cmd, 0, sizeof(cmd));
+	if (ring_reserve(0, &cmd.offset) != SR_OK)
+		return SR_ERR;
+	farm->unitsize = unitsize;
+	cmd.type = CMD_START;
+	cmd.num_probes = num_probes;
+	cmd.unitsize = unitsize;
+	cmd.arg = samplerate;
+	send_cmd(&cmd);
+
+	return farm->failed ? SR_ERR : SR_OK;
+}
+
+/**
+ * Send a block of samples to all workers for decoding.
+ *
+ * @param start_sample Number of the first sample in the block.
+ * @param data The samples. They are copied.
+ * @param len Length of the samples, in bytes.
+ *
+ * @return SR_OK upon success, SR_ERR if decoding failed.
+ */
+int pd_farm_send(uint64_t start_sample, const uint8_t *data, uint64_t len)
+{
+	struct farm_cmd cmd;
+	uint64_t n;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.type = CMD_DATA;
+	while (len > 0) {
+		n = MIN(len, (uint64_t)(MAX_BLOCK_SIZE
+				- MAX_BLOCK_SIZE % farm->unitsize));
+		if (ring_reserve(n, &cmd.offset) != SR_OK)
+			return SR_ERR;
+		memcpy(farm->ring + cmd.offset, data, n);
+		cmd.arg = start_sample;
+		cmd.len = n;
+		send_cmd(&cmd);
+		data += n;
+		len -= n;
+		start_sample += n / farm->unitsize;
+	}
+
+	/* Print what's come back so far, without waiting. */
+	farm_read(0);
+
+	return farm->failed ? SR_ERR : SR_OK;
+}
+
+/**
+ * Wait for all workers to finish decoding, and print the remaining
+ * annotations.
+ *
+ * @return SR_OK upon success, SR_ERR if decoding failed.
+ */
+int pd_farm_session_end(void)
+{
+	struct farm_cmd cmd;
+
+	memset(&cmd, 0, sizeof(cmd));
+	if (ring_reserve(0, &cmd.offset) != SR_OK)
+		return SR_ERR;
+	cmd.type = CMD_END;
+	send_cmd(&cmd);
+	while (farm->out_seq < farm->seq) {
+		/* Don't wait for blocks no live worker can still finish. */
+		if (farm->failed && !farm_live())
+			break;
+		farm_read(-1);
+	}
+
+	return farm->failed ? SR_ERR : SR_OK;
+}
+
+/**
+ * Stop all worker processes.
+ */
+void pd_farm_stop(void)
+{
+	if (farm)
+		farm_free();
+}
+
+#else
+
+void pd_farm_annotation(const char *line, gsize len)
+{
+	(void)line;
+	(void)len;
+}
+
+int pd_farm_start(const char *pds, const char *stack, int jobs,
+		pd_farm_setup_cb setup, pd_farm_ann_cb ann_cb)
+{
+	(void)pds;
+	(void)stack;
+	(void)setup;
+	(void)ann_cb;
+
+	if (jobs > 1)
+		g_warning("Protocol decoder worker processes are not "
+				"supported on this platform.");
+
+	return 0;
+}
+
+int pd_farm_session_start(int num_probes, int unitsize, uint64_t samplerate)
+{
+	(void)num_probes;
+	(void)unitsize;
+	(void)samplerate;
+
+	return SR_ERR_BUG;
+}
+
+int pd_farm_send(uint64_t start_sample, const uint8_t *data, uint64_t len)
+{
+	(void)start_sample;
+	(void)data;
+	(void)len;
+
+	return SR_ERR_BUG;
+}
+
+int pd_farm_session_end(void)
+{
+	return SR_ERR_BUG;
+}
+
+void pd_farm_stop(void)
+{
+}
+
+#endif
@@ -0,0 +1,326 @@
+/*
+ * This file is part of the sigrok project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sigrokdecode.h> /* First, so we avoid a _POSIX_C_SOURCE warning. */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "sigrok-cli.h"
+
+/*
+ * Protocol decoders run on their own thread, so a slow decoder doesn't
+ * hold up the datafeed callback and make the device overrun. Sample blocks
+ * are passed on through a single-producer, single-consumer ring: the ring
+ * indices are only ever advanced by one side each, so the fast path needs
+ * no locking. The mutex and condition variables are only used to sleep
+ * when the ring is empty (decoder thread) or full (datafeed callback).
+ *
+ * All calls into libsigrokdecode for the session happen on the decoder
+ * thread, one at a time, so the Python interpreter is never entered from
+ * two threads at once.
+ *
+ * With a flush interval, the decoder thread doesn't sleep longer than that
+ * while the ring is empty, so annotations held back by the --flush policy
+ * still go out when the device is quiet.
+ */
+
+enum {
+	PD_BLOCK_START,
+	PD_BLOCK_DATA,
+	PD_BLOCK_END,
+};
+
+struct pd_block {
+	int type;
+	uint64_t start_sample;
+	uint8_t *data;
+	uint64_t len;
+	uint64_t size;
+	/* PD_BLOCK_START */
+	int num_probes;
+	int unitsize;
+	uint64_t samplerate;
+};
+
+struct pd_queue {
+	struct pd_block *blocks;
+	guint depth;
+	gboolean abort_on_overrun;
+	/* Next block to fill, only advanced by the datafeed callback. */
+	volatile gint head;
+	/* Next block to decode, only advanced by the decoder thread. */
+	volatile gint tail;
+	GMutex mutex;
+	GCond not_empty;
+	GCond not_full;
+	volatile gint producer_waiting;
+	volatile gint consumer_waiting;
+	volatile gint failed;
+	GThread *thread;
+	/* In us, or 0. */
+	gint64 flush_interval;
+	uint64_t overruns;
+	int high_water;
+};
+
+static struct pd_queue *q = NULL;
+
+static guint queued(void)
+{
+	return (guint)(g_atomic_int_get(&q->head) - g_atomic_int_get(&q->tail));
+}
+
+static gpointer pd_thread(gpointer data)
+{
+	struct pd_block *b;
+	gint64 t;
+	int ret;
+
+	(void)data;
+
+	for (;;) {
+		if (queued() == 0) {
+			g_mutex_lock(&q->mutex);
+			g_atomic_int_set(&q->consumer_waiting, TRUE);
+			while (queued() == 0) {
+				if (!q->flush_interval) {
+					g_cond_wait(&q->not_empty, &q->mutex);
+				} else if (!g_cond_wait_until(&q->not_empty,
+						&q->mutex, g_get_monotonic_time()
+						+ q->flush_interval)) {
+					g_mutex_unlock(&q->mutex);
+					pd_annotations_flush();
+					g_mutex_lock(&q->mutex);
+				}
+			}
+			g_atomic_int_set(&q->consumer_waiting, FALSE);
+			g_mutex_unlock(&q->mutex);
+		}
+
+		b = &q->blocks[(guint)g_atomic_int_get(&q->tail) % q->depth];
+		if (b->type == PD_BLOCK_END)
+			break;
+
+		if (!g_atomic_int_get(&q->failed)) {
+			if (b->type == PD_BLOCK_START)
+				ret = srd_session_start(b->num_probes,
+						b->unitsize, b->samplerate);
+			else {
+				t = stats_start();
+				ret = srd_session_send(b->start_sample,
+						b->data, b->len);
+				stats_stop(STATS_SRD_SEND, t);
+			}
+			if (ret != SRD_OK)
+				g_atomic_int_set(&q->failed, TRUE);
+			pd_annotations_flush();
+		}
+
+		g_atomic_int_inc(&q->tail);
+		if (g_atomic_int_get(&q->producer_waiting)) {
+			g_mutex_lock(&q->mutex);
+			g_cond_signal(&q->not_full);
+			g_mutex_unlock(&q->mutex);
+		}
+	}
+
+	return NULL;
+}
+
+/* Get the next free block, waiting until fewer than limit are queued. */
+static struct pd_block *block_get(guint limit)
+{
+	if (queued() >= limit) {
+		g_mutex_lock(&q->mutex);
+		g_atomic_int_set(&q->producer_waiting, TRUE);
+		while (queued() >= limit)
+			g_cond_wait(&q->not_full, &q->mutex);
+		g_atomic_int_set(&q->producer_waiting, FALSE);
+		g_mutex_unlock(&q->mutex);
+	}
+
+	return &q->blocks[(guint)g_atomic_int_get(&q->head) % q->depth];
+}
+
+/* Hand the block filled in by the last block_get() to the decoder. */
+static void block_put(void)
+{
+	int n;
+
+	g_atomic_int_inc(&q->head);
+	if (g_atomic_int_get(&q->consumer_waiting)) {
+		g_mutex_lock(&q->mutex);
+		g_cond_signal(&q->not_empty);
+		g_mutex_unlock(&q->mutex);
+	}
+
+	n = queued();
+	if (n > q->high_water)
+		q->high_water = n;
+}
+
+/**
+ * Start the decoder thread, and the protocol decoder session on it.
+ *
+ * @param depth Number of sample blocks that can be queued up.
+ * @param abort_on_overrun If TRUE, a full queue is an error. Otherwise
+ *                         the datafeed waits until there's room.
+ * @param num_probes Number of probes in the samples.
+ * @param unitsize Size of one sample, in bytes.
+ * @param samplerate The samplerate.
+ * @param flush_interval If not 0, annotations are checked for being due to
+ *                       be written out at least every this many ms.
+ *
+ * @return SR_OK upon success, or an SR_ERR* code upon errors.
+ */
+int pd_queue_start(int depth, gboolean abort_on_overrun, int num_probes,
+		int unitsize, uint64_t samplerate, uint64_t flush_interval)
+{
+	struct pd_block *b;
+	GError *error;
+
+	if (q) {
+		g_critical("Protocol decoder queue already running.");
+		return SR_ERR_BUG;
+	}
+	/* One slot more, for the end marker. */
+	depth++;
+	if (!(q = g_try_malloc0(sizeof(struct pd_queue)))
+			|| !(q->blocks = g_try_malloc0(depth * sizeof(struct pd_block)))) {
+		g_critical("Protocol decoder queue malloc failed.");
+		g_free(q);
+		q = NULL;
+		return SR_ERR_MALLOC;
+	}
+	q->depth = depth;
+	q->abort_on_overrun = abort_on_overrun;
+	q->flush_interval = flush_interval * 1000;
+	g_mutex_init(&q->mutex);
+	g_cond_init(&q->not_empty);
+	g_cond_init(&q->not_full);
+
+	b = block_get(q->depth);
+	b->type = PD_BLOCK_START;
+	b->num_probes = num_probes;
+	b->unitsize = unitsize;
+	b->samplerate = samplerate;
+	block_put();
+
+	error = NULL;
+	if (!(q->thread = g_thread_try_new("decoder", pd_thread, NULL,
+			&error))) {
+		g_critical("Failed to start decoder thread: %s.",
+				error->message);
+		g_error_free(error);
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Queue a block of samples for decoding.
+ *
+ * @param start_sample Number of the first sample in the block.
+ * @param data The samples. They are copied.
+ * @param len Length of the samples, in bytes.
+ *
+ * @return SR_OK upon success, SR_ERR if decoding failed or the queue
+ *         overran.
+ */
+int pd_queue_send(uint64_t start_sample, const uint8_t *data, uint64_t len)
+{
+	struct pd_block *b;
+	uint8_t *buf;
+
+	if (g_atomic_int_get(&q->failed))
+		return SR_ERR;
+
+	/* The last slot is kept free for the end marker. */
+	if (q->abort_on_overrun && queued() >= q->depth - 1) {
+		q->overruns++;
+		return SR_ERR;
+	}
+	b = block_get(q->depth - 1);
+
+	/* Blocks keep their buffers, grown as needed. */
+	if (len > b->size) {
+		if (!(buf = g_try_realloc(b->data, len))) {
+			g_critical("Protocol decoder block malloc failed.");
+			return SR_ERR_MALLOC;
+		}
+		b->data = buf;
+		b->size = len;
+	}
+	memcpy(b->data, data, len);
+	b->len = len;
+	b->start_sample = start_sample;
+	b->type = PD_BLOCK_DATA;
+	block_put();
+
+	return SR_OK;
+}
+
+/**
+ * Wait for all queued samples to be decoded, and stop the decoder thread.
+ *
+ * @return SR_OK upon success, SR_ERR if decoding failed or the queue
+ *         overran.
+ */
+int pd_queue_end(void)
+{
+	struct pd_block *b;
+	guint i;
+	int ret;
+
+	if (!q)
+		return SR_OK;
+
+	if (q->thread) {
+		b = block_get(q->depth);
+		b->type = PD_BLOCK_END;
+		block_put();
+		g_thread_join(q->thread);
+	}
+
+	ret = SR_OK;
+	g_debug("cli: Protocol decoder queue high-water mark %d/%d blocks.",
+			q->high_water, q->depth - 1);
+	if (q->overruns) {
+		g_critical("Protocol decoder queue overrun: %" PRIu64 " sample "
+				"blocks could not be decoded.", q->overruns);
+		ret = SR_ERR;
+	}
+	if (g_atomic_int_get(&q->failed))
+		ret = SR_ERR;
+
+	for (i = 0; i < q->depth; i++)
+		g_free(q->blocks[i].data);
+	g_free(q->blocks);
+	g_mutex_clear(&q->mutex);
+	g_cond_clear(&q->not_empty);
+	g_cond_clear(&q->not_full);
+	g_free(q);
+	q = NULL;
+
+	return ret;
+}
@@ -0,0 +1,131 @@
+/*
+ * This file is part of the sigrok project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "sigrok-cli.h"
+
+/*
+ * While waiting for a trigger, the last so many samples are kept in a
+ * circular buffer, so they can be passed on once the trigger fires. Only
+ * whole samples go in, and the oldest are overwritten as new ones come in.
+ */
+
+struct pretrig {
+	uint8_t *buf;
+	/* All in bytes. */
+	uint64_t size;
+	uint64_t pos;
+	uint64_t len;
+};
+
+/**
+ * Create a pre-trigger buffer.
+ *
+ * @param num_samples Number of samples to keep.
+ * @param unitsize Size of one sample, in bytes.
+ *
+ * @return The buffer, or NULL upon errors.
+ */
+struct pretrig *pretrig_new(uint64_t num_samples, int unitsize)
+{
+	struct pretrig *pt;
+
+	if (!(pt = g_try_malloc0(sizeof(struct pretrig)))) {
+		g_critical("Pre-trigger buffer malloc failed.");
+		return NULL;
+	}
+	pt->size = num_samples * unitsize;
+	if (!(pt->buf = g_try_malloc(pt->size))) {
+		g_critical("Pre-trigger buffer malloc failed.");
+		g_free(pt);
+		return NULL;
+	}
+
+	return pt;
+}
+
+/**
+ * Add samples to a pre-trigger buffer.
+ *
+ * @param pt The buffer.
+ * @param data The samples.
+ * @param len Length of the samples, in bytes.
+ *
+ * @return The number of bytes of older samples pushed out.
+ */
+uint64_t pretrig_put(struct pretrig *pt, const uint8_t *data, uint64_t len)
+{
+	uint64_t dropped, n;
+
+	/* Only the tail end of a big packet can fit. */
+	dropped = 0;
+	if (len > pt->size) {
+		dropped = len - pt->size;
+		data += dropped;
+		len = pt->size;
+	}
+	if (pt->len + len > pt->size)
+		dropped += pt->len + len - pt->size;
+
+	n = MIN(len, pt->size - pt->pos);
+	memcpy(pt->buf + pt->pos, data, n);
+	memcpy(pt->buf, data + n, len - n);
+	pt->pos = (pt->pos + len) % pt->size;
+	pt->len = MIN(pt->len + len, pt->size);
+
+	return dropped;
+}
+
+/**
+ * Take the oldest samples out of a pre-trigger buffer. It takes at most
+ * two calls to empty it.
+ *
+ * @param pt The buffer.
+ * @param data Set to the samples, which stay valid until the next
+ *             pretrig_put().
+ *
+ * @return Length of the samples, in bytes. 0 if the buffer is empty.
+ */
+uint64_t pretrig_get(struct pretrig *pt, const uint8_t **data)
+{
+	uint64_t start, len;
+
+	if (pt->len == 0)
+		return 0;
+
+	start = (pt->pos + pt->size - pt->len) % pt->size;
+	len = MIN(pt->len, pt->size - start);
+	*data = pt->buf + start;
+	pt->len -= len;
+
+	return len;
+}
+
+void pretrig_destroy(struct pretrig *pt)
+{
+	if (!pt)
+		return;
+
+	g_free(pt->buf);
+	g_free(pt);
+}
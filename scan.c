@@ -0,0 +1,434 @@
+/*
+ * This file is part of the sigrok project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "sigrok-cli.h"
+
+/* Most of a scan is spent waiting on USB and serial ports, not the CPU. */
+#define MAX_SCAN_THREADS 16
+
+/*
+ * Every driver is initialized and scanned on a thread of its own, so the
+ * slow ones (mostly those probing serial ports) don't add up. A driver
+ * that is still scanning when the timeout runs out is left behind: its
+ * devices aren't used, but it has to finish before libsigrok is shut
+ * down, which scan_wait() takes care of.
+ */
+
+struct scan_job {
+	struct sr_dev_driver *driver;
+	struct sr_context *ctx;
+	GSList *devices;
+	int ret;
+	gint64 time;
+	gboolean done;
+};
+
+struct scan {
+	GThreadPool *pool;
+	struct scan_job *jobs;
+};
+
+/* Scans with drivers left behind, still to be waited for. */
+static GSList *scans = NULL;
+static GMutex scan_mutex;
+static GCond scan_cond;
+
+static void scan_thread(gpointer data, gpointer user_data)
+{
+	struct scan_job *job;
+	GSList *devices;
+	gint64 start;
+	int ret;
+
+	(void)user_data;
+
+	job = data;
+	start = g_get_monotonic_time();
+	devices = NULL;
+	if ((ret = sr_driver_init(job->ctx, job->driver)) == SR_OK)
+		devices = sr_driver_scan(job->driver, NULL);
+
+	g_mutex_lock(&scan_mutex);
+	job->ret = ret;
+	job->devices = devices;
+	job->time = g_get_monotonic_time() - start;
+	job->done = TRUE;
+	g_cond_signal(&scan_cond);
+	g_mutex_unlock(&scan_mutex);
+}
+
+static void scan_free(struct scan *scan)
+{
+	g_thread_pool_free(scan->pool, FALSE, TRUE);
+	g_free(scan->jobs);
+	g_free(scan);
+}
+
+/* Scan the drivers given. The devices they found go in *devices. */
+static int scan_drivers(struct sr_context *ctx,
+		struct sr_dev_driver **drivers, int num_drivers,
+		uint64_t timeout_ms, GSList **devices)
+{
+	struct scan *scan;
+	struct scan_job *job;
+	GError *error;
+	gint64 deadline;
+	int pending, i;
+	gboolean failed;
+
+	*devices = NULL;
+	if (num_drivers == 0)
+		return SR_OK;
+	if (!(scan = g_try_malloc0(sizeof(struct scan)))
+			|| !(scan->jobs = g_try_malloc0(num_drivers
+			* sizeof(struct scan_job)))) {
+		g_critical("Driver scan malloc failed.");
+		g_free(scan);
+		return SR_ERR_MALLOC;
+	}
+
+	error = NULL;
+	if (!(scan->pool = g_thread_pool_new(scan_thread, NULL,
+			MIN(num_drivers, MAX_SCAN_THREADS), FALSE, &error))) {
+		g_critical("Failed to start driver scan threads: %s.",
+				error->message);
+		g_error_free(error);
+		g_free(scan->jobs);
+		g_free(scan);
+		return SR_ERR;
+	}
+
+	deadline = g_get_monotonic_time() + timeout_ms * 1000;
+	for (i = 0; i < num_drivers; i++) {
+		scan->jobs[i].driver = drivers[i];
+		scan->jobs[i].ctx = ctx;
+		g_thread_pool_push(scan->pool, &scan->jobs[i], NULL);
+	}
+
+	g_mutex_lock(&scan_mutex);
+	for (;;) {
+		for (i = pending = 0; i < num_drivers; i++)
+			pending += !scan->jobs[i].done;
+		if (pending == 0)
+			break;
+		if (!timeout_ms)
+			g_cond_wait(&scan_cond, &scan_mutex);
+		else if (!g_cond_wait_until(&scan_cond, &scan_mutex, deadline))
+			break;
+	}
+
+	/* Merge in driver order, whatever order they finished in. */
+	failed = FALSE;
+	for (i = 0; i < num_drivers; i++) {
+		job = &scan->jobs[i];
+		if (!job->done) {
+			g_warning("Driver %s didn't finish scanning within "
+					"%" PRIu64 " ms, skipping it.",
+					job->driver->name, timeout_ms);
+			continue;
+		}
+		if (job->ret != SR_OK) {
+			g_critical("Failed to initialize driver %s.",
+					job->driver->name);
+			failed = TRUE;
+			continue;
+		}
+		g_debug("cli: Driver %s found %d devices in %.1f ms.",
+				job->driver->name, g_slist_length(job->devices),
+				job->time / 1000.0);
+		*devices = g_slist_concat(*devices, job->devices);
+		job->devices = NULL;
+	}
+	g_mutex_unlock(&scan_mutex);
+
+	/* Nothing left behind, the threads can go. */
+	if (pending == 0)
+		scan_free(scan);
+	else
+		scans = g_slist_append(scans, scan);
+
+	if (failed) {
+		g_slist_free(*devices);
+		*devices = NULL;
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+/*
+ * The scan cache remembers which drivers found which devices last time.
+ * libsigrok doesn't tell us how a device is connected, so a device is
+ * recognized by its driver, vendor, model, version and number of probes.
+ */
+
+static char *scan_cache_path(void)
+{
+	return g_build_filename(g_get_user_cache_dir(), "sigrok-cli",
+			"scan-cache", NULL);
+}
+
+static char *dev_desc(const struct sr_dev_inst *sdi)
+{
+	return g_strdup_printf("%s:%s:%s:%s:%d", sdi->driver->name,
+			sdi->vendor ? sdi->vendor : "",
+			sdi->model ? sdi->model : "",
+			sdi->version ? sdi->version : "",
+			g_slist_length(sdi->probes));
+}
+
+/*
+ * Load the scan cache: the drivers that found devices last time, and
+ * the devices they found.
+ */
+static int scan_cache_load(struct sr_dev_driver ***cached, int *num_cached,
+		gchar ***descs, gsize *num_descs)
+{
+	struct sr_dev_driver **drivers;
+	GKeyFile *kf;
+	gchar **names;
+	char *path;
+	gsize num_names;
+	int ret, i, j;
+
+	kf = g_key_file_new();
+	path = scan_cache_path();
+	names = *descs = NULL;
+	*cached = NULL;
+	*num_cached = 0;
+	ret = SR_ERR;
+	if (!g_key_file_load_from_file(kf, path, G_KEY_FILE_NONE, NULL)
+			|| !(names = g_key_file_get_string_list(kf, "scan",
+			"drivers", &num_names, NULL))
+			|| !(*descs = g_key_file_get_string_list(kf, "scan",
+			"devices", num_descs, NULL))) {
+		g_debug("cli: No usable scan cache in %s.", path);
+		goto done;
+	}
+
+	if (!(*cached = g_try_malloc0((num_names + 1) * sizeof(**cached)))) {
+		g_critical("Scan cache malloc failed.");
+		ret = SR_ERR_MALLOC;
+		goto done;
+	}
+	drivers = sr_driver_list();
+	for (i = 0; names[i]; i++) {
+		for (j = 0; drivers[j]; j++) {
+			if (!strcmp(drivers[j]->name, names[i]))
+				break;
+		}
+		if (!drivers[j]) {
+			g_debug("cli: Cached driver %s is gone.", names[i]);
+			goto done;
+		}
+		(*cached)[(*num_cached)++] = drivers[j];
+	}
+	ret = SR_OK;
+
+done:
+	if (ret != SR_OK) {
+		g_strfreev(*descs);
+		*descs = NULL;
+		g_free(*cached);
+		*cached = NULL;
+		*num_cached = 0;
+	}
+	g_strfreev(names);
+	g_free(path);
+	g_key_file_free(kf);
+
+	return ret;
+}
+
+/* Only the very same devices will do. */
+static gboolean scan_cache_match(GSList *devices, gchar **descs,
+		gsize num_descs)
+{
+	GSList *l;
+	char *desc;
+	gboolean match;
+	int i;
+
+	match = g_slist_length(devices) == num_descs;
+	for (l = devices, i = 0; match && l; l = l->next, i++) {
+		desc = dev_desc(l->data);
+		match = !strcmp(desc, descs[i]);
+		g_free(desc);
+	}
+
+	return match;
+}
+
+static void scan_cache_store(GSList *devices)
+{
+	GKeyFile *kf;
+	GSList *l;
+	GPtrArray *names, *descs;
+	GError *error;
+	struct sr_dev_inst *sdi;
+	const char *last;
+	char *path, *dir, *data;
+	gsize len;
+
+	names = g_ptr_array_new();
+	descs = g_ptr_array_new_with_free_func(g_free);
+	last = NULL;
+	for (l = devices; l; l = l->next) {
+		sdi = l->data;
+		if (!last || strcmp(last, sdi->driver->name))
+			g_ptr_array_add(names, sdi->driver->name);
+		last = sdi->driver->name;
+		g_ptr_array_add(descs, dev_desc(sdi));
+	}
+
+	kf = g_key_file_new();
+	g_key_file_set_string_list(kf, "scan", "drivers",
+			(const gchar * const *)names->pdata, names->len);
+	g_key_file_set_string_list(kf, "scan", "devices",
+			(const gchar * const *)descs->pdata, descs->len);
+	data = g_key_file_to_data(kf, &len, NULL);
+
+	path = scan_cache_path();
+	dir = g_path_get_dirname(path);
+	error = NULL;
+	if (g_mkdir_with_parents(dir, 0700) != 0)
+		g_warning("Failed to create %s.", dir);
+	else if (!g_file_set_contents(path, data, len, &error)) {
+		g_warning("Failed to save scan cache: %s.", error->message);
+		g_error_free(error);
+	}
+
+	g_free(dir);
+	g_free(path);
+	g_free(data);
+	g_key_file_free(kf);
+	g_ptr_array_free(descs, TRUE);
+	g_ptr_array_free(names, TRUE);
+}
+
+static int driver_index(struct sr_dev_driver **drivers,
+		const struct sr_dev_driver *driver)
+{
+	int i;
+
+	for (i = 0; drivers[i] && drivers[i] != driver; i++)
+		;
+
+	return i;
+}
+
+static gint driver_order(gconstpointer a, gconstpointer b, gpointer data)
+{
+	const struct sr_dev_inst *sdi_a = a, *sdi_b = b;
+
+	return driver_index(data, sdi_a->driver)
+			- driver_index(data, sdi_b->driver);
+}
+
+/**
+ * Initialize and scan all drivers at the same time.
+ *
+ * @param ctx The libsigrok context.
+ * @param timeout_ms How long to wait for the drivers, in milliseconds, or
+ *                   0 to wait for as long as it takes.
+ * @param use_cache If TRUE, first try only the drivers that found devices
+ *                  last time. If they don't find the same devices again,
+ *                  the rest of the drivers are scanned as well. The result
+ *                  of such a full scan is saved for next time.
+ *
+ * @return The devices found, in driver order. NULL if none were found,
+ *         or a driver failed to initialize.
+ */
+GSList *scan_all(struct sr_context *ctx, uint64_t timeout_ms,
+		gboolean use_cache)
+{
+	struct sr_dev_driver **drivers, **cached, **rest;
+	GSList *devices, *more;
+	gchar **descs;
+	gsize num_descs;
+	int num_cached, num_rest, i, j;
+
+	drivers = sr_driver_list();
+	devices = NULL;
+	cached = NULL;
+	num_cached = 0;
+	descs = NULL;
+	if (use_cache && scan_cache_load(&cached, &num_cached,
+			&descs, &num_descs) == SR_OK) {
+		if (scan_drivers(ctx, cached, num_cached, timeout_ms,
+				&devices) != SR_OK)
+			goto done;
+		if (scan_cache_match(devices, descs, num_descs)) {
+			g_debug("cli: Using cached scan result.");
+			goto done;
+		}
+		g_debug("cli: Cached devices not found, doing a full scan.");
+	}
+
+	/* The cached drivers have had their turn already. */
+	for (num_rest = 0; drivers[num_rest]; num_rest++)
+		;
+	if (!(rest = g_try_malloc0((num_rest + 1) * sizeof(*rest)))) {
+		g_critical("Driver scan malloc failed.");
+		g_slist_free(devices);
+		devices = NULL;
+		goto done;
+	}
+	for (i = num_rest = 0; drivers[i]; i++) {
+		for (j = 0; j < num_cached && cached[j] != drivers[i]; j++)
+			;
+		if (j == num_cached)
+			rest[num_rest++] = drivers[i];
+	}
+	if (scan_drivers(ctx, rest, num_rest, timeout_ms, &more) != SR_OK) {
+		g_slist_free(devices);
+		devices = NULL;
+	} else {
+		devices = g_slist_sort_with_data(g_slist_concat(devices, more),
+				driver_order, drivers);
+		if (use_cache && devices)
+			scan_cache_store(devices);
+	}
+	g_free(rest);
+
+done:
+	g_strfreev(descs);
+	g_free(cached);
+
+	return devices;
+}
+
+/**
+ * Wait for drivers left behind by scan_all() to finish scanning.
+ */
+void scan_wait(void)
+{
+	GSList *l;
+
+	for (l = scans; l; l = l->next)
+		scan_free(l->data);
+	g_slist_free(scans);
+	scans = NULL;
+}
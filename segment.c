@@ -0,0 +1,139 @@
+/*
+ * This file is part of the sigrok project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libsigrok/libsigrok.h>
+#include "sigrok-cli.h"
+
+/*
+ * A long capture can be split into a series of output files, each one
+ * complete in itself. This keeps track of the segments written so far,
+ * and deletes the oldest ones to stay within a maximum number of files,
+ * or of bytes on disk.
+ */
+
+struct segment {
+	char *filename;
+	uint64_t size;
+};
+
+struct segments {
+	uint64_t max_count;
+	uint64_t max_bytes;
+	/* Closed segments, oldest first. */
+	GQueue files;
+	uint64_t bytes;
+};
+
+/**
+ * Start keeping track of segments.
+ *
+ * @param max_count Maximum number of segments to keep, 0 for no limit.
+ * @param max_bytes Maximum total size of the segments to keep, in bytes,
+ *                  0 for no limit.
+ *
+ * @return The segment list, or NULL upon errors.
+ */
+struct segments *segments_new(uint64_t max_count, uint64_t max_bytes)
+{
+	struct segments *sg;
+
+	if (!(sg = g_try_malloc0(sizeof(struct segments)))) {
+		g_critical("Segment list malloc failed.");
+		return NULL;
+	}
+	sg->max_count = max_count;
+	sg->max_bytes = max_bytes;
+	g_queue_init(&sg->files);
+
+	return sg;
+}
+
+static void segment_free(struct segment *seg)
+{
+	g_free(seg->filename);
+	g_free(seg);
+}
+
+/**
+ * Add a segment which has just been closed, and delete the oldest ones
+ * if there are now too many. The newest segment is always kept.
+ *
+ * @param sg The segment list.
+ * @param filename The segment's file.
+ * @param next_size If another segment is about to be written, how big it
+ *                  is expected to get, so there's room for it. Pass 0
+ *                  after the last one.
+ * @param more TRUE if another segment is about to be written.
+ */
+void segments_add(struct segments *sg, const char *filename,
+		uint64_t next_size, gboolean more)
+{
+	struct segment *seg;
+	struct stat st;
+	uint64_t count;
+
+	if (g_stat(filename, &st) != 0) {
+		g_critical("Failed to stat %s: %s.", filename, strerror(errno));
+		return;
+	}
+
+	if (!(seg = g_try_malloc(sizeof(struct segment)))) {
+		g_critical("Segment malloc failed.");
+		return;
+	}
+	seg->filename = g_strdup(filename);
+	seg->size = st.st_size;
+	g_queue_push_tail(&sg->files, seg);
+	sg->bytes += seg->size;
+
+	while ((count = g_queue_get_length(&sg->files)) > 1) {
+		if (!(sg->max_count && count + (more ? 1 : 0) > sg->max_count)
+				&& !(sg->max_bytes
+				&& sg->bytes + next_size > sg->max_bytes))
+			break;
+		seg = g_queue_pop_head(&sg->files);
+		g_debug("cli: Deleting segment %s.", seg->filename);
+		if (g_unlink(seg->filename) != 0)
+			g_warning("Failed to delete segment %s.", seg->filename);
+		sg->bytes -= seg->size;
+		segment_free(seg);
+	}
+}
+
+void segments_destroy(struct segments *sg)
+{
+	struct segment *seg;
+
+	if (!sg)
+		return;
+
+	while ((seg = g_queue_pop_head(&sg->files)))
+		segment_free(seg);
+	g_free(sg);
+}
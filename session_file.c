@@ -0,0 +1,775 @@
+/*
+ * This file is part of the sigrok project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libsigrok/libsigrok.h>
+#include "sigrok-cli.h"
+
+#ifdef HAVE_FTRUNCATE
+#include <unistd.h>
+#endif
+
+/*
+ * Streaming writer for sigrok session files.
+ *
+ * A session file is a ZIP archive holding a "version" file, a "metadata"
+ * file and the logic data in "logic-1". Rather than collecting all samples
+ * in memory and having libsigrok write the archive at the end, this writes
+ * the archive as the samples come in:
+ *
+ *   [version] [metadata] [logic-1 ......] [central directory]
+ *
+ * The logic data is the last member, and is stored uncompressed so it can
+ * keep growing. Every time a chunk of samples is appended, the central
+ * directory is written out again and the logic member's CRC and size are
+ * updated in place, so the file is a valid session file up to the last
+ * chunk written. The logic member always carries ZIP64 size fields, so
+ * captures can grow past 4GB.
+ *
+ * While samples come in, the directory is kept a chunk past the end of the
+ * samples, where the next chunk can't reach it:
+ *
+ *   [version] [metadata] [logic-1 ......] [next chunk ...] [directory]
+ *
+ * Each new directory goes past the last one, so the file's end always holds
+ * a complete directory, whenever sigrok-cli is interrupted. ZIP readers
+ * only go by the offsets in the directory, so the gap doesn't matter. Once
+ * the session file is closed, the directory is moved up to right after the
+ * samples, and the gap is cut off.
+ *
+ * All writes go through an output writer, so the disk doesn't hold up the
+ * session thread.
+ */
+
+#define CHUNK_SIZE (4 * 1024 * 1024)
+#define MAX_METADATA_SIZE (64 * 1024)
+
+#define ZIP_LOCAL_SIG      0x04034b50
+#define ZIP_CENTRAL_SIG    0x02014b50
+#define ZIP_EOCD_SIG       0x06054b50
+#define ZIP64_EOCD_SIG     0x06064b50
+#define ZIP64_LOCATOR_SIG  0x07064b50
+#define ZIP64_EXTRA_ID     0x0001
+#define ZIP_VERSION        20
+#define ZIP64_VERSION      45
+#define ZIP_LOCAL_HDR_LEN  30
+#define ZIP_CENTRAL_LEN    46
+#define ZIP_EOCD_LEN       22
+#define ZIP64_LOCATOR_LEN  20
+#define ZIP64_EOCD_LEN     56
+#define ZIP_MAX_COMMENT    0xffff
+#define ZIP_MAX32          0xffffffffU
+
+struct zip_member {
+	const char *name;
+	uint64_t offset;
+	uint64_t size;
+	uint32_t crc;
+	gboolean zip64;
+};
+
+struct session_file {
+	char *filename;
+	FILE *fp;
+	struct writer *writer;
+	uint16_t dos_time;
+	uint16_t dos_date;
+	struct zip_member members[3];
+	/* The logic data member, always the last one. */
+	struct zip_member *logic;
+	/* End of the data written so far. */
+	uint64_t end;
+	/* Samples written since the directory was. */
+	uint64_t pending;
+	/* Where the last directory written is, at the end of the file. */
+	uint64_t cd_offset;
+	uint64_t cd_end;
+	gboolean failed;
+};
+
+static uint32_t crc_table[256];
+
+static void crc_table_init(void)
+{
+	uint32_t c;
+	int i, j;
+
+	if (crc_table[1])
+		return;
+
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (j = 0; j < 8; j++)
+			c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+		crc_table[i] = c;
+	}
+}
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *p, uint64_t len)
+{
+	crc = ~crc;
+	while (len--)
+		crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+	return ~crc;
+}
+
+static void put16(GString *s, uint16_t v)
+{
+	g_string_append_c(s, v & 0xff);
+	g_string_append_c(s, v >> 8);
+}
+
+static void put32(GString *s, uint32_t v)
+{
+	put16(s, v & 0xffff);
+	put16(s, v >> 16);
+}
+
+static void put64(GString *s, uint64_t v)
+{
+	put32(s, v & 0xffffffff);
+	put32(s, v >> 32);
+}
+
+static void zip_local_header(const struct session_file *sf,
+		const struct zip_member *m, GString *s)
+{
+	put32(s, ZIP_LOCAL_SIG);
+	put16(s, m->zip64 ? ZIP64_VERSION : ZIP_VERSION);
+	put16(s, 0);
+	/* Stored, not compressed. */
+	put16(s, 0);
+	put16(s, sf->dos_time);
+	put16(s, sf->dos_date);
+	put32(s, m->crc);
+	if (m->zip64) {
+		put32(s, ZIP_MAX32);
+		put32(s, ZIP_MAX32);
+	} else {
+		put32(s, m->size);
+		put32(s, m->size);
+	}
+	put16(s, strlen(m->name));
+	put16(s, m->zip64 ? 20 : 0);
+	g_string_append(s, m->name);
+	if (m->zip64) {
+		put16(s, ZIP64_EXTRA_ID);
+		put16(s, 16);
+		put64(s, m->size);
+		put64(s, m->size);
+	}
+}
+
+static void zip_central_header(const struct session_file *sf,
+		const struct zip_member *m, GString *s)
+{
+	gboolean big_offset;
+	int extra_len;
+
+	big_offset = m->offset >= ZIP_MAX32;
+	extra_len = 0;
+	if (m->zip64 || big_offset)
+		extra_len = 4 + (m->zip64 ? 16 : 0) + (big_offset ? 8 : 0);
+
+	put32(s, ZIP_CENTRAL_SIG);
+	/* Made by: UNIX. */
+	put16(s, (3 << 8) | ZIP64_VERSION);
+	put16(s, extra_len ? ZIP64_VERSION : ZIP_VERSION);
+	put16(s, 0);
+	put16(s, 0);
+	put16(s, sf->dos_time);
+	put16(s, sf->dos_date);
+	put32(s, m->crc);
+	if (m->zip64) {
+		put32(s, ZIP_MAX32);
+		put32(s, ZIP_MAX32);
+	} else {
+		put32(s, m->size);
+		put32(s, m->size);
+	}
+	put16(s, strlen(m->name));
+	put16(s, extra_len);
+	/* Comment, disk number, internal attributes. */
+	put16(s, 0);
+	put16(s, 0);
+	put16(s, 0);
+	/* External attributes: regular file, 0644. */
+	put32(s, 0100644U << 16);
+	put32(s, big_offset ? ZIP_MAX32 : m->offset);
+	g_string_append(s, m->name);
+	if (extra_len) {
+		put16(s, ZIP64_EXTRA_ID);
+		put16(s, extra_len - 4);
+		if (m->zip64) {
+			put64(s, m->size);
+			put64(s, m->size);
+		}
+		if (big_offset)
+			put64(s, m->offset);
+	}
+}
+
+static void zip_central_directory(const struct session_file *sf,
+		uint64_t cd_offset, GString *s)
+{
+	uint64_t cd_size, eocd64_offset;
+	int num, i;
+
+	num = G_N_ELEMENTS(sf->members);
+	for (i = 0; i < num; i++)
+		zip_central_header(sf, &sf->members[i], s);
+	cd_size = s->len;
+
+	if (cd_offset >= ZIP_MAX32) {
+		eocd64_offset = cd_offset + cd_size;
+		put32(s, ZIP64_EOCD_SIG);
+		put64(s, 44);
+		put16(s, (3 << 8) | ZIP64_VERSION);
+		put16(s, ZIP64_VERSION);
+		put32(s, 0);
+		put32(s, 0);
+		put64(s, num);
+		put64(s, num);
+		put64(s, cd_size);
+		put64(s, cd_offset);
+
+		put32(s, ZIP64_LOCATOR_SIG);
+		put32(s, 0);
+		put64(s, eocd64_offset);
+		put32(s, 1);
+	}
+
+	put32(s, ZIP_EOCD_SIG);
+	put16(s, 0);
+	put16(s, 0);
+	put16(s, num);
+	put16(s, num);
+	put32(s, cd_size);
+	put32(s, cd_offset >= ZIP_MAX32 ? ZIP_MAX32 : cd_offset);
+	put16(s, 0);
+}
+
+static int write_at(struct session_file *sf, uint64_t offset,
+		const void *data, uint64_t len)
+{
+	writer_seek(sf->writer, offset);
+	if (writer_write(sf->writer, data, len) != SR_OK) {
+		g_critical("Failed to write session file %s.", sf->filename);
+		sf->failed = TRUE;
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+/* Add a small member with the given contents, before the logic data. */
+static int add_member(struct session_file *sf, struct zip_member *m,
+		const char *name, const char *data, uint64_t len)
+{
+	GString *s;
+	int ret;
+
+	m->name = name;
+	m->offset = sf->end;
+	m->size = len;
+	m->crc = crc32_update(0, (const uint8_t *)data, len);
+	m->zip64 = FALSE;
+
+	s = g_string_sized_new(ZIP_LOCAL_HDR_LEN + strlen(name) + len);
+	zip_local_header(sf, m, s);
+	g_string_append_len(s, data, len);
+	ret = write_at(sf, sf->end, s->str, s->len);
+	sf->end += s->len;
+	g_string_free(s, TRUE);
+
+	return ret;
+}
+
+static GString *build_metadata(const struct sr_dev_inst *sdi, int unitsize,
+		uint64_t samplerate, const struct timeval *starttime)
+{
+	struct sr_probe *probe;
+	GString *meta;
+	GSList *l;
+	int num_probes, probecnt;
+	char *s;
+
+	meta = g_string_sized_new(256);
+	g_string_append_printf(meta, "[global]\nsigrok version = %s\n\n",
+			sr_package_version_string_get());
+	g_string_append(meta, "[device 1]\n");
+	if (sdi->driver)
+		g_string_append_printf(meta, "driver = %s\n", sdi->driver->name);
+	g_string_append(meta, "capturefile = logic-1\n");
+	g_string_append_printf(meta, "unitsize = %d\n", unitsize);
+
+	num_probes = 0;
+	for (l = sdi->probes; l; l = l->next) {
+		probe = l->data;
+		if (probe->enabled && probe->type == SR_PROBE_LOGIC)
+			num_probes++;
+	}
+	/* The samples were filtered, only the enabled probes are stored. */
+	g_string_append_printf(meta, "total probes = %d\n", num_probes);
+	if (samplerate && (s = sr_samplerate_string(samplerate))) {
+		g_string_append_printf(meta, "samplerate = %s\n", s);
+		g_free(s);
+	}
+	/* Lets captures from several devices be lined up. */
+	if (starttime && starttime->tv_sec)
+		g_string_append_printf(meta, "starttime = %ld.%06ld\n",
+				(long)starttime->tv_sec,
+				(long)starttime->tv_usec);
+
+	probecnt = 1;
+	for (l = sdi->probes; l; l = l->next) {
+		probe = l->data;
+		if (!probe->enabled || probe->type != SR_PROBE_LOGIC)
+			continue;
+		if (probe->name)
+			g_string_append_printf(meta, "probe%d = %s\n",
+					probecnt, probe->name);
+		if (probe->trigger)
+			g_string_append_printf(meta, " trigger%d = %s\n",
+					probecnt, probe->trigger);
+		probecnt++;
+	}
+
+	return meta;
+}
+
+/*
+ * Write the directory for the samples so far at cd_offset, and point the
+ * logic member's header at them.
+ */
+static int directory_write(struct session_file *sf, uint64_t cd_offset)
+{
+	GString *s;
+	int ret;
+
+	if (sf->failed)
+		return SR_ERR;
+
+	s = g_string_sized_new(512);
+	zip_central_directory(sf, cd_offset, s);
+	ret = write_at(sf, cd_offset, s->str, s->len);
+	sf->cd_offset = cd_offset;
+	sf->cd_end = cd_offset + s->len;
+
+	if (ret == SR_OK) {
+		g_string_truncate(s, 0);
+		zip_local_header(sf, sf->logic, s);
+		ret = write_at(sf, sf->logic->offset, s->str, s->len);
+	}
+	g_string_free(s, TRUE);
+
+	/* The next samples follow on from the last ones. */
+	writer_seek(sf->writer, sf->end);
+	sf->pending = 0;
+
+	return ret;
+}
+
+/*
+ * Write the directory a chunk past the samples, and past the last
+ * directory, which stays intact until the new one is complete.
+ */
+static int session_file_sync(struct session_file *sf)
+{
+	return directory_write(sf, MAX(sf->end + CHUNK_SIZE, sf->cd_end));
+}
+
+/* Move the directory up to right after the samples, and cut off the rest. */
+static int session_file_finish(struct session_file *sf)
+{
+#ifdef HAVE_FTRUNCATE
+	GString *s;
+	uint64_t len;
+
+	/* Without overwriting the last directory, until the file is cut. */
+	s = g_string_sized_new(512);
+	zip_central_directory(sf, sf->end, s);
+	len = s->len;
+	g_string_free(s, TRUE);
+	if (sf->end + len > sf->cd_offset && session_file_sync(sf) != SR_OK)
+		return SR_ERR;
+
+	if (directory_write(sf, sf->end) != SR_OK
+			|| writer_sync(sf->writer) != SR_OK)
+		return SR_ERR;
+	if (ftruncate(fileno(sf->fp), sf->cd_end) != 0) {
+		g_critical("Failed to write session file %s: %s.",
+				sf->filename, strerror(errno));
+		sf->failed = TRUE;
+		return SR_ERR;
+	}
+
+	return SR_OK;
+#else
+	/* The gap stays, which ZIP readers don't mind. */
+	return session_file_sync(sf);
+#endif
+}
+
+/**
+ * Create a session file, to be filled with logic samples as they arrive.
+ *
+ * @param filename The file to write.
+ * @param sdi The device the samples come from.
+ * @param unitsize Size of one (filtered) sample, in bytes.
+ * @param samplerate The samplerate, or 0 if not known.
+ * @param starttime When the acquisition started, or NULL if not known.
+ *
+ * @return A new session file writer, or NULL upon error.
+ */
+struct session_file *session_file_new(const char *filename,
+		const struct sr_dev_inst *sdi, int unitsize,
+		uint64_t samplerate, const struct timeval *starttime)
+{
+	struct session_file *sf;
+	struct tm *tm;
+	GString *meta;
+	time_t now;
+	int ret;
+
+	crc_table_init();
+
+	if (!(sf = g_try_malloc0(sizeof(struct session_file)))) {
+		g_critical("Session file malloc failed.");
+		return NULL;
+	}
+	if (!(sf->fp = g_fopen(filename, "wb"))) {
+		g_critical("Failed to create %s: %s.", filename,
+				strerror(errno));
+		g_free(sf);
+		return NULL;
+	}
+	if (!(sf->writer = writer_new(sf->fp, 0))) {
+		fclose(sf->fp);
+		g_free(sf);
+		return NULL;
+	}
+	sf->filename = g_strdup(filename);
+
+	now = time(NULL);
+	tm = localtime(&now);
+	sf->dos_time = (tm->tm_hour << 11) | (tm->tm_min << 5) | (tm->tm_sec / 2);
+	sf->dos_date = ((tm->tm_year - 80) << 9) | ((tm->tm_mon + 1) << 5)
+			| tm->tm_mday;
+
+	meta = build_metadata(sdi, unitsize, samplerate, starttime);
+	ret = add_member(sf, &sf->members[0], "version", "1", 1);
+	if (ret == SR_OK)
+		ret = add_member(sf, &sf->members[1], "metadata", meta->str,
+				meta->len);
+	g_string_free(meta, TRUE);
+
+	sf->logic = &sf->members[2];
+	sf->logic->name = "logic-1";
+	sf->logic->offset = sf->end;
+	sf->logic->zip64 = TRUE;
+	sf->end += ZIP_LOCAL_HDR_LEN + strlen(sf->logic->name) + 20;
+
+	if (ret != SR_OK || session_file_sync(sf) != SR_OK) {
+		session_file_close(sf);
+		return NULL;
+	}
+
+	return sf;
+}
+
+/**
+ * Append logic samples to a session file.
+ *
+ * The directory is updated after every chunk of samples.
+ *
+ * @param sf The session file.
+ * @param data The samples.
+ * @param len Length of the samples, in bytes.
+ *
+ * @return SR_OK upon success, SR_ERR upon write errors.
+ */
+int session_file_append(struct session_file *sf, const uint8_t *data,
+		uint64_t len)
+{
+	struct zip_member *m;
+	uint64_t n;
+
+	if (sf->failed)
+		return SR_ERR;
+
+	m = sf->logic;
+	while (len > 0) {
+		n = MIN(len, CHUNK_SIZE - sf->pending);
+		if (writer_write(sf->writer, data, n) != SR_OK) {
+			sf->failed = TRUE;
+			return SR_ERR;
+		}
+		m->crc = crc32_update(m->crc, data, n);
+		m->size += n;
+		sf->end += n;
+		sf->pending += n;
+		data += n;
+		len -= n;
+		if (sf->pending == CHUNK_SIZE
+				&& session_file_sync(sf) != SR_OK)
+			return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+/**
+ * Write out any remaining samples and close the session file.
+ *
+ * @param sf The session file. May be NULL.
+ *
+ * @return SR_OK upon success, SR_ERR if the file could not be written.
+ */
+int session_file_close(struct session_file *sf)
+{
+	int ret;
+
+	if (!sf)
+		return SR_OK;
+
+	ret = SR_OK;
+	if (sf->logic && !sf->failed && session_file_finish(sf) != SR_OK)
+		ret = SR_ERR;
+	if (writer_sync(sf->writer) != SR_OK)
+		ret = SR_ERR;
+	writer_destroy(sf->writer);
+	if (fclose(sf->fp) != 0)
+		ret = SR_ERR;
+	if (sf->failed)
+		ret = SR_ERR;
+
+	g_free(sf->filename);
+	g_free(sf);
+
+	return ret;
+}
+
+/* Reading it back in. */
+
+static uint16_t get16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+	return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+static uint64_t get64(const uint8_t *p)
+{
+	return get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+static int read_at(FILE *fp, uint64_t offset, void *buf, uint64_t len)
+{
+	if (fseeko(fp, offset, SEEK_SET) != 0
+			|| fread(buf, 1, len, fp) != len)
+		return SR_ERR;
+
+	return SR_OK;
+}
+
+/* Where a stored member's data starts, or 0 if it isn't stored. */
+static uint64_t member_data(FILE *fp, const uint8_t *central,
+		uint64_t *size)
+{
+	const uint8_t *extra, *end;
+	uint8_t local[ZIP_LOCAL_HDR_LEN];
+	uint64_t offset;
+	int i;
+
+	/* Only uncompressed members can be read at an offset. */
+	if (get16(central + 10) != 0)
+		return 0;
+
+	*size = get32(central + 24);
+	offset = get32(central + 42);
+	/* ZIP64 fields are there only for the values which didn't fit. */
+	extra = central + ZIP_CENTRAL_LEN + get16(central + 28);
+	end = extra + get16(central + 30);
+	while (extra + 4 <= end) {
+		if (get16(extra) == ZIP64_EXTRA_ID) {
+			i = 4;
+			if (*size == ZIP_MAX32)
+				*size = get64(extra + i), i += 8;
+			if (get32(central + 20) == ZIP_MAX32)
+				i += 8;
+			if (offset == ZIP_MAX32)
+				offset = get64(extra + i);
+			break;
+		}
+		extra += 4 + get16(extra + 2);
+	}
+
+	if (read_at(fp, offset, local, ZIP_LOCAL_HDR_LEN) != SR_OK
+			|| get32(local) != ZIP_LOCAL_SIG)
+		return 0;
+
+	return offset + ZIP_LOCAL_HDR_LEN + get16(local + 26)
+			+ get16(local + 28);
+}
+
+static int parse_metadata(const char *data, gsize len,
+		struct sample_index *idx)
+{
+	GKeyFile *kf;
+	char *val, key[32];
+	int num_probes, i;
+
+	kf = g_key_file_new();
+	if (!g_key_file_load_from_data(kf, data, len, 0, NULL)) {
+		g_key_file_free(kf);
+		return SR_ERR;
+	}
+
+	idx->unitsize = g_key_file_get_integer(kf, "device 1", "unitsize",
+			NULL);
+	num_probes = g_key_file_get_integer(kf, "device 1", "total probes",
+			NULL);
+	if ((val = g_key_file_get_string(kf, "device 1", "samplerate",
+			NULL))) {
+		if (sr_parse_sizestring(val, &idx->samplerate) != SR_OK)
+			idx->samplerate = 0;
+		g_free(val);
+	}
+	if (idx->unitsize < 1 || num_probes < 1 || num_probes > SR_MAX_NUM_PROBES
+			|| !(idx->probe_names = g_try_malloc0((num_probes + 1)
+			* sizeof(char *)))) {
+		g_key_file_free(kf);
+		return SR_ERR;
+	}
+	for (i = 0; i < num_probes; i++) {
+		snprintf(key, sizeof(key), "probe%d", i + 1);
+		if (!(idx->probe_names[i] = g_key_file_get_string(kf,
+				"device 1", key, NULL)))
+			idx->probe_names[i] = g_strdup_printf("%d", i);
+	}
+	g_key_file_free(kf);
+
+	return SR_OK;
+}
+
+/**
+ * Index a session file, if its samples can be read at an offset: that's
+ * when they're stored uncompressed, as written by session_file_new().
+ *
+ * @param filename The file.
+ * @param idx The index to fill in.
+ *
+ * @return SR_OK upon success, or SR_ERR if the file can't be indexed.
+ */
+int session_file_index(const char *filename, struct sample_index *idx)
+{
+	FILE *fp;
+	uint8_t *buf, *cd, *p, loc[ZIP64_LOCATOR_LEN], eocd64[ZIP64_EOCD_LEN];
+	char *meta;
+	uint64_t size, len, cd_offset, cd_size, num, meta_size, logic_size;
+	uint64_t eocd, meta_offset, logic_offset, i;
+	int ret;
+
+	if (!(fp = g_fopen(filename, "rb")))
+		return SR_ERR;
+
+	buf = cd = NULL;
+	meta = NULL;
+	ret = SR_ERR;
+	if (fseeko(fp, 0, SEEK_END) != 0 || (size = ftello(fp)) < ZIP_EOCD_LEN)
+		goto done;
+
+	/* The end of central directory record is at the end, before an
+	 * optional comment. */
+	len = MIN(size, ZIP_EOCD_LEN + ZIP_MAX_COMMENT);
+	if (!(buf = g_try_malloc(len))
+			|| read_at(fp, size - len, buf, len) != SR_OK)
+		goto done;
+	for (p = buf + len - ZIP_EOCD_LEN; p >= buf; p--) {
+		if (get32(p) == ZIP_EOCD_SIG)
+			break;
+	}
+	if (p < buf)
+		goto done;
+	eocd = size - len + (p - buf);
+	num = get16(p + 10);
+	cd_size = get32(p + 12);
+	cd_offset = get32(p + 16);
+	if (cd_offset == ZIP_MAX32 && eocd >= ZIP64_LOCATOR_LEN) {
+		if (read_at(fp, eocd - ZIP64_LOCATOR_LEN, loc,
+				ZIP64_LOCATOR_LEN) != SR_OK
+				|| get32(loc) != ZIP64_LOCATOR_SIG
+				|| read_at(fp, get64(loc + 8), eocd64,
+				ZIP64_EOCD_LEN) != SR_OK
+				|| get32(eocd64) != ZIP64_EOCD_SIG)
+			goto done;
+		num = get64(eocd64 + 32);
+		cd_size = get64(eocd64 + 40);
+		cd_offset = get64(eocd64 + 48);
+	}
+	if (cd_size > MAX_METADATA_SIZE || !(cd = g_try_malloc(cd_size))
+			|| read_at(fp, cd_offset, cd, cd_size) != SR_OK)
+		goto done;
+
+	meta_offset = logic_offset = 0;
+	meta_size = logic_size = 0;
+	for (p = cd, i = 0; i < num; i++) {
+		if (p + ZIP_CENTRAL_LEN > cd + cd_size
+				|| get32(p) != ZIP_CENTRAL_SIG)
+			goto done;
+		len = get16(p + 28);
+		if (len == 8 && !memcmp(p + ZIP_CENTRAL_LEN, "metadata", 8))
+			meta_offset = member_data(fp, p, &meta_size);
+		else if (len == 7 && !memcmp(p + ZIP_CENTRAL_LEN, "logic-1", 7))
+			logic_offset = member_data(fp, p, &logic_size);
+		p += ZIP_CENTRAL_LEN + len + get16(p + 30) + get16(p + 32);
+	}
+	if (!meta_offset || !logic_offset || meta_size > MAX_METADATA_SIZE)
+		goto done;
+
+	if (!(meta = g_try_malloc(meta_size))
+			|| read_at(fp, meta_offset, meta, meta_size) != SR_OK
+			|| parse_metadata(meta, meta_size, idx) != SR_OK)
+		goto done;
+
+	idx->type = INDEX_SESSION;
+	idx->data_offset = logic_offset;
+	idx->num_samples = logic_size / idx->unitsize;
+	ret = SR_OK;
+
+done:
+	g_free(meta);
+	g_free(cd);
+	g_free(buf);
+	fclose(fp);
+
+	return ret;
+}
@@ -35,25 +35,129 @@
 #include "config.h"
 
 #define DEFAULT_OUTPUT_FORMAT "bits:width=64"
+#define DEFAULT_INPUT_CHUNKSIZE (4 * 1024 * 1024)
+#define DEFAULT_PD_QUEUE_DEPTH 64
+#define DEFAULT_SCAN_TIMEOUT 5000
+#define DEFAULT_BENCHMARK_SAMPLES (16 * 1024 * 1024)
+#define ANN_BUFSIZE (64 * 1024)
 
 static struct sr_context *sr_ctx = NULL;
 
 static uint64_t limit_samples = 0;
+static uint64_t pre_trigger = 0;
+static uint64_t segment_size = 0;
+static uint64_t segment_time = 0;
+static uint64_t segment_limit = 0;
+static uint64_t decimate_factor = 0;
+static int decimate_mode = DECIMATE_SAMPLE;
+static uint64_t analog_stats_window = 0;
 static uint64_t limit_frames = 0;
 static struct sr_output_format *output_format = NULL;
 static int default_output_format = FALSE;
 static char *output_format_param = NULL;
+/* Bitmask of annotation classes to show, by decoder instance ID. */
 static GHashTable *pd_ann_visible = NULL;
-static struct sr_datastore *singleds = NULL;
+/* The same, looked up once per decoder output. */
+static GHashTable *pd_ann_masks = NULL;
+static int pd_ann_format = ANN_FORMAT_TEXT;
+static int flush_mode = FLUSH_PACKET;
+static uint64_t flush_arg = 0;
+static int pd_queue_depth = DEFAULT_PD_QUEUE_DEPTH;
+static gboolean pd_queue_abort = FALSE;
+static int pd_farm_workers = 0;
+static gboolean pd_farm_worker = FALSE;
+/* Without -s, all protocol decoders go on one stack. */
+static gboolean pd_autostack = TRUE;
+static uint64_t scan_timeout = DEFAULT_SCAN_TIMEOUT;
+
+/* Output produced since the last flush, for the --flush policy. */
+struct flush_state {
+	uint64_t bytes;
+	gint64 last;
+};
+static struct flush_state ann_flush = { 0, 0 };
+/* Annotations come from the decoder thread. */
+static GMutex ann_flush_mutex;
+/* Annotations waiting to be written out, under ann_flush_mutex. */
+static GString *ann_buf = NULL;
+
+/* Datafeed state, one for every device in the session. */
+struct dev_state {
+	const struct sr_dev_inst *sdi;
+	/* Position in the device list. */
+	int index;
+	/* Where to write the output, NULL for stdout. */
+	char *output_file;
+	/* Whether the protocol decoders get this device's samples. */
+	gboolean decode;
+	uint64_t limit_samples;
+	/* Time limit in ms, for devices that can't do it themselves. */
+	uint64_t limit_time;
+	gint64 acq_start;
+	gboolean limit_reached;
+	/* Samples still to be read past, for --start without an index. */
+	uint64_t skip_samples;
+	struct timeval starttime;
+	struct sr_output *o;
+	struct probe_filter *pf;
+	int logic_probelist[SR_MAX_NUM_PROBES + 1];
+	int analog_probelist[SR_MAX_NUM_PROBES + 1];
+	int num_analog_probes;
+	int num_enabled_analog_probes;
+	struct analog_filter *af;
+	uint64_t received_samples;
+	int unitsize;
+	gboolean triggered;
+	FILE *outfile;
+	struct writer *writer;
+	struct session_file *sfile;
+	struct flush_state out_flush;
+	/* Samples from before the trigger, with --pre-trigger. */
+	struct pretrig *pretrig;
+	/* Trigger for devices which can't do it themselves. */
+	struct swtrig *swtrig;
+	/* With --decimate, what goes to the output is cut down. */
+	struct decimator *dec_logic;
+	struct decimator *dec_analog;
+	/* With --analog-stats, analog samples only go into these. */
+	struct analog_stats *astats;
+	/* With --analog-threshold, analog probes are decoded as logic. */
+	struct threshold *athr;
+	/* With --logic-stats, logic samples only go into these. */
+	struct logic_stats *lstats;
+	/* With --segment-size or --segment-time, the output file is split. */
+	struct segments *segments;
+	int segment;
+	char *segment_file;
+	uint64_t segment_bytes;
+	gint64 segment_start;
+	/* What the output format was started with, to restart it. */
+	struct sr_datafeed_header header;
+	int meta_type;
+	struct sr_datafeed_meta_logic meta_logic;
+	struct sr_datafeed_meta_analog meta_analog;
+};
+static GHashTable *dev_states = NULL;
+static int devs_running = 0;
+/* Taken just before the devices are started, for aligning them. */
+static struct timeval session_start = { 0, 0 };
+/* sr_session_stop() is only called once, from the end of datafeed_in(). */
+static gboolean session_running = FALSE;
+static gboolean stop_requested = FALSE;
+/* Something went wrong along the way, though the session ran to its end. */
+static gboolean datafeed_failed = FALSE;
+/* Only the part given with --start and --end was read from the file. */
+static gboolean window_read = FALSE;
 
 static gboolean opt_version = FALSE;
 static gint opt_loglevel = SR_LOG_WARN; /* Show errors+warnings per default. */
 static gboolean opt_list_devs = FALSE;
 static gboolean opt_wait_trigger = FALSE;
 static gchar *opt_input_file = NULL;
+static gchar **opt_input_files = NULL;
 static gchar *opt_output_file = NULL;
 static gchar *opt_drv = NULL;
-static gchar *opt_dev = NULL;
+static gchar **opt_dev = NULL;
 static gchar *opt_probes = NULL;
 static gchar *opt_triggers = NULL;
 static gchar *opt_pds = NULL;
@@ -66,6 +170,30 @@ static gchar *opt_time = NULL;
 static gchar *opt_samples = NULL;
 static gchar *opt_frames = NULL;
 static gchar *opt_continuous = NULL;
+static gchar *opt_flush = NULL;
+static gint opt_pd_queue = DEFAULT_PD_QUEUE_DEPTH;
+static gchar *opt_pd_overflow = NULL;
+static gint opt_pd_jobs = 1;
+static gint opt_jobs = 1;
+static gchar *opt_scan_timeout = NULL;
+static gboolean opt_scan_cache = FALSE;
+static gboolean opt_benchmark = FALSE;
+static gboolean opt_stats = FALSE;
+static gchar *opt_pd_format = NULL;
+static gchar *opt_pre_trigger = NULL;
+static gboolean opt_sw_trigger = FALSE;
+static gchar *opt_segment_size = NULL;
+static gchar *opt_segment_time = NULL;
+static gint opt_segment_keep = 0;
+static gchar *opt_segment_limit = NULL;
+static gchar *opt_start = NULL;
+static gchar *opt_end = NULL;
+static gchar *opt_decimate = NULL;
+static gchar *opt_decimate_mode = NULL;
+static gchar *opt_analog_stats = NULL;
+static gchar *opt_analog_threshold = NULL;
+static gboolean opt_logic_stats = FALSE;
+static gchar *opt_logic_stats_interval = NULL;
 
 static GOptionEntry optargs[] = {
 	{"version", 'V', 0, G_OPTION_ARG_NONE, &opt_version,
@@ -76,10 +204,14 @@ static GOptionEntry optargs[] = {
 			"Scan for devices", NULL},
 	{"driver", 0, 0, G_OPTION_ARG_STRING, &opt_drv,
 			"Use only this driver", NULL},
-	{"device", 'd', 0, G_OPTION_ARG_STRING, &opt_dev,
-			"Use specified device", NULL},
-	{"input-file", 'i', 0, G_OPTION_ARG_FILENAME, &opt_input_file,
-			"Load input from file", NULL},
+	{"scan-timeout", 0, 0, G_OPTION_ARG_STRING, &opt_scan_timeout,
+			"How long to scan for devices (ms)", NULL},
+	{"scan-cache", 0, 0, G_OPTION_ARG_NONE, &opt_scan_cache,
+			"Try the devices found last time first", NULL},
+	{"device", 'd', 0, G_OPTION_ARG_STRING_ARRAY, &opt_dev,
+			"Use specified device(s)", NULL},
+	{"input-file", 'i', 0, G_OPTION_ARG_FILENAME_ARRAY, &opt_input_files,
+			"Load input from file(s)", NULL},
 	{"input-format", 'I', 0, G_OPTION_ARG_STRING, &opt_input_format,
 			"Input format", NULL},
 	{"output-file", 'o', 0, G_OPTION_ARG_FILENAME, &opt_output_file,
@@ -92,22 +224,67 @@ static GOptionEntry optargs[] = {
 			"Trigger configuration", NULL},
 	{"wait-trigger", 'w', 0, G_OPTION_ARG_NONE, &opt_wait_trigger,
 			"Wait for trigger", NULL},
+	{"pre-trigger", 0, 0, G_OPTION_ARG_STRING, &opt_pre_trigger,
+			"Samples to keep from before the trigger", NULL},
+	{"sw-trigger", 0, 0, G_OPTION_ARG_NONE, &opt_sw_trigger,
+			"Evaluate triggers in software", NULL},
+	{"segment-size", 0, 0, G_OPTION_ARG_STRING, &opt_segment_size,
+			"Start a new output file after this many bytes", NULL},
+	{"segment-time", 0, 0, G_OPTION_ARG_STRING, &opt_segment_time,
+			"Start a new output file after this long", NULL},
+	{"segment-keep", 0, 0, G_OPTION_ARG_INT, &opt_segment_keep,
+			"Number of output files to keep", NULL},
+	{"segment-limit", 0, 0, G_OPTION_ARG_STRING, &opt_segment_limit,
+			"Total size of output files to keep", NULL},
 	{"protocol-decoders", 'a', 0, G_OPTION_ARG_STRING, &opt_pds,
 			"Protocol decoders to run", NULL},
 	{"protocol-decoder-stack", 's', 0, G_OPTION_ARG_STRING, &opt_pd_stack,
 			"Protocol decoder stack", NULL},
 	{"protocol-decoder-annotations", 'A', 0, G_OPTION_ARG_STRING, &opt_pd_annotations,
 			"Protocol decoder annotation(s) to show", NULL},
+	{"pd-queue", 0, 0, G_OPTION_ARG_INT, &opt_pd_queue,
+			"Protocol decoder queue depth", NULL},
+	{"pd-overflow", 0, 0, G_OPTION_ARG_STRING, &opt_pd_overflow,
+			"Protocol decoder queue overflow policy", NULL},
+	{"pd-jobs", 0, 0, G_OPTION_ARG_INT, &opt_pd_jobs,
+			"Number of protocol decoder processes", NULL},
+	{"jobs", 0, 0, G_OPTION_ARG_INT, &opt_jobs,
+			"Number of input files to process at once", NULL},
+	{"pd-format", 0, 0, G_OPTION_ARG_STRING, &opt_pd_format,
+			"Protocol decoder annotation format", NULL},
+	{"benchmark", 0, 0, G_OPTION_ARG_NONE, &opt_benchmark,
+			"Measure how fast samples are processed", NULL},
+	{"stats", 0, 0, G_OPTION_ARG_NONE, &opt_stats,
+			"Show where time is spent processing samples", NULL},
 	{"show", 0, 0, G_OPTION_ARG_NONE, &opt_show,
 			"Show device detail", NULL},
 	{"time", 0, 0, G_OPTION_ARG_STRING, &opt_time,
 			"How long to sample (ms)", NULL},
 	{"samples", 0, 0, G_OPTION_ARG_STRING, &opt_samples,
 			"Number of samples to acquire", NULL},
+	{"start", 0, 0, G_OPTION_ARG_STRING, &opt_start,
+			"Where in the input file to start", NULL},
+	{"end", 0, 0, G_OPTION_ARG_STRING, &opt_end,
+			"Where in the input file to stop", NULL},
+	{"decimate", 0, 0, G_OPTION_ARG_STRING, &opt_decimate,
+			"Only output one of every so many samples", NULL},
+	{"decimate-mode", 0, 0, G_OPTION_ARG_STRING, &opt_decimate_mode,
+			"How logic samples are decimated", NULL},
+	{"analog-stats", 0, 0, G_OPTION_ARG_STRING, &opt_analog_stats,
+			"Output analog statistics instead of samples", NULL},
+	{"analog-threshold", 0, 0, G_OPTION_ARG_STRING, &opt_analog_threshold,
+			"Levels to decode analog probes as logic at", NULL},
+	{"logic-stats", 0, 0, G_OPTION_ARG_NONE, &opt_logic_stats,
+			"Output logic statistics instead of samples", NULL},
+	{"logic-stats-interval", 0, 0, G_OPTION_ARG_STRING,
+			&opt_logic_stats_interval,
+			"How often to output logic statistics", NULL},
 	{"frames", 0, 0, G_OPTION_ARG_STRING, &opt_frames,
 			"Number of frames to acquire", NULL},
 	{"continuous", 0, 0, G_OPTION_ARG_NONE, &opt_continuous,
 			"Sample continuously", NULL},
+	{"flush", 0, 0, G_OPTION_ARG_STRING, &opt_flush,
+			"Output flush policy", NULL},
 	{NULL, 0, 0, 0, NULL, NULL, NULL}
 };
 
@@ -144,7 +321,7 @@ static GSList *device_scan(void)
 {
 	struct sr_dev_driver **drivers, *driver;
 	GHashTable *drvargs;
-	GSList *drvopts, *devices, *tmpdevs, *l;
+	GSList *drvopts, *devices;
 	int i;
 	char *drvname;
 
@@ -176,19 +353,7 @@ static GSList *device_scan(void)
 		devices = sr_driver_scan(driver, drvopts);
 	} else {
 		/* No driver specified, let them all scan on their own. */
-		devices = NULL;
-		drivers = sr_driver_list();
-		for (i = 0; drivers[i]; i++) {
-			driver = drivers[i];
-			if (sr_driver_init(sr_ctx, driver) != SR_OK) {
-				g_critical("Failed to initialize driver.");
-				return NULL;
-			}
-			tmpdevs = sr_driver_scan(driver, NULL);
-			for (l = tmpdevs; l; l = l->next)
-				devices = g_slist_append(devices, l->data);
-			g_slist_free(tmpdevs);
-		}
+		devices = scan_all(sr_ctx, scan_timeout, opt_scan_cache);
 	}
 
 	return devices;
@@ -221,12 +386,18 @@ static void show_version(void)
 	inputs = sr_input_list();
 	for (i = 0; inputs[i]; i++)
 		printf("  %-20s %s\n", inputs[i]->id, inputs[i]->description);
+	printf("  %-20s %s\n", output_transitions.id,
+			output_transitions.description);
 	printf("\n");
 
 	printf("Supported output formats:\n");
 	outputs = sr_output_list();
 	for (i = 0; outputs[i]; i++)
 		printf("  %-20s %s\n", outputs[i]->id, outputs[i]->description);
+	printf("  %-20s %s\n", output_transitions.id,
+			output_transitions.description);
+	printf("  %-20s %s\n", output_analog_bin.id,
+			output_analog_bin.description);
 	printf("\n");
 
 	if (srd_init(NULL) == SRD_OK) {
@@ -313,7 +484,7 @@ static void show_dev_detail(void)
 			return;
 		}
 		/* opt_dev is NULL if not specified, which is fine. */
-		n = strtol(opt_dev, NULL, 10);
+		n = strtol(opt_dev[0], NULL, 10);
 		if (n >= num_devices) {
 			g_critical("%d devices found, numbered starting from 0.",
 					num_devices);
@@ -539,36 +710,630 @@ static void show_pd_detail(void)
 	g_strfreev(pdtokens);
 }
 
+static void dev_state_free(struct dev_state *ds)
+{
+	swtrig_destroy(ds->swtrig);
+	segments_destroy(ds->segments);
+	g_free(ds->segment_file);
+	g_free(ds->output_file);
+	g_free(ds);
+}
+
+static struct dev_state *dev_state_new(const struct sr_dev_inst *sdi,
+		int index)
+{
+	struct dev_state *ds;
+
+	if (!dev_states)
+		dev_states = g_hash_table_new_full(g_direct_hash,
+				g_direct_equal, NULL,
+				(GDestroyNotify)dev_state_free);
+
+	if (!(ds = g_try_malloc0(sizeof(struct dev_state)))) {
+		g_critical("Device state malloc failed.");
+		exit(1);
+	}
+	ds->sdi = sdi;
+	ds->index = index;
+	ds->output_file = g_strdup(opt_output_file);
+	ds->decode = (opt_pds != NULL);
+	ds->limit_samples = limit_samples;
+	ds->logic_probelist[0] = -1;
+	g_hash_table_insert(dev_states, (gpointer)sdi, ds);
+
+	return ds;
+}
+
+/* Devices not set up by run_session(), like input files, get defaults. */
+static struct dev_state *dev_state_get(const struct sr_dev_inst *sdi)
+{
+	struct dev_state *ds;
+
+	if (dev_states && (ds = g_hash_table_lookup(dev_states, sdi)))
+		return ds;
+
+	return dev_state_new(sdi, 0);
+}
+
+static void dev_states_destroy(void)
+{
+	if (dev_states)
+		g_hash_table_destroy(dev_states);
+	dev_states = NULL;
+}
+
+/* Queue a chunk of output module data for writing, and free it. */
+static void output_put(struct dev_state *ds, uint8_t *buf, uint64_t len)
+{
+	if (ds->writer) {
+		writer_write(ds->writer, buf, len);
+		ds->out_flush.bytes += len;
+		ds->segment_bytes += len;
+	}
+	g_free(buf);
+}
+
+/*
+ * Statistics go where the samples would have, except that a session file
+ * only holds samples: they're shown on stdout then.
+ */
+static void summary_put(struct dev_state *ds, uint8_t *buf, uint64_t len)
+{
+	if (ds->writer) {
+		output_put(ds, buf, len);
+		return;
+	}
+	fwrite(buf, 1, len, stdout);
+	fflush(stdout);
+	g_free(buf);
+}
+
+/* Check whether output written since the last flush should go out now. */
+static gboolean flush_due(struct flush_state *fs)
+{
+	gint64 now;
+
+	if (fs->bytes == 0)
+		return FALSE;
+
+	now = g_get_monotonic_time();
+	switch (flush_mode) {
+	case FLUSH_PACKET:
+		break;
+	case FLUSH_SIZE:
+		if (fs->bytes < flush_arg)
+			return FALSE;
+		break;
+	case FLUSH_TIME:
+		if (now - fs->last < (gint64)flush_arg * 1000)
+			return FALSE;
+		break;
+	default:
+		/* FLUSH_END */
+		return FALSE;
+	}
+	fs->bytes = 0;
+	fs->last = now;
+
+	return TRUE;
+}
+
+/* Write out buffered annotations. The caller holds ann_flush_mutex. */
+static void ann_write(gboolean sync)
+{
+	gint64 t;
+
+	if (ann_buf && ann_buf->len) {
+		t = stats_start();
+		fwrite(ann_buf->str, 1, ann_buf->len, stdout);
+		stats_stop(STATS_FWRITE, t);
+		g_string_truncate(ann_buf, 0);
+	}
+	if (sync)
+		fflush(stdout);
+}
+
+/* Hand a packet to output formats which take whole packets. */
+static void output_recv(struct dev_state *ds, const struct sr_dev_inst *sdi,
+		const struct sr_datafeed_packet *packet)
+{
+	GString *out;
+	gint64 t;
+
+	if (!ds->o->format->recv)
+		return;
+	if (ds->lstats && packet->type == SR_DF_LOGIC)
+		return;
+
+	t = stats_start();
+	out = ds->o->format->recv(ds->o, sdi, packet);
+	stats_stop(STATS_OUTPUT, t);
+	if (out && out->len && ds->writer) {
+		writer_write(ds->writer, out->str, out->len);
+		ds->out_flush.bytes += out->len;
+		ds->segment_bytes += out->len;
+	}
+}
+
+/* The device's samplerate, or 0 if it doesn't have one. */
+static uint64_t dev_samplerate(const struct sr_dev_inst *sdi)
+{
+	uint64_t *samplerate;
+
+	if (!sdi->driver || !sr_dev_has_hwcap(sdi, SR_HWCAP_SAMPLERATE)
+			|| sr_info_get(sdi->driver, SR_DI_CUR_SAMPLERATE,
+			(const void **)&samplerate, sdi) != SR_OK
+			|| !samplerate)
+		return 0;
+
+	return *samplerate;
+}
+
+/* Start decoding, with the decoder thread or the worker processes. */
+static void decode_start(int num_probes, int unitsize, uint64_t samplerate)
+{
+	int ret;
+
+	if (pd_farm_workers)
+		ret = pd_farm_session_start(num_probes, unitsize, samplerate);
+	else
+		ret = pd_queue_start(pd_queue_depth, pd_queue_abort,
+				num_probes, unitsize, samplerate,
+				flush_mode == FLUSH_TIME ? flush_arg : 0);
+	if (ret != SR_OK)
+		exit(1);
+}
+
+/* Hand logic samples to the decoders. */
+static void decode_send(uint64_t start_sample, const uint8_t *data,
+		uint64_t len)
+{
+	gint64 t;
+	int ret;
+
+	t = stats_start();
+	if (pd_farm_workers)
+		ret = pd_farm_send(start_sample, data, len);
+	else
+		ret = pd_queue_send(start_sample, data, len);
+	stats_stop(STATS_DECODE, t);
+	if (ret != SR_OK)
+		stop_requested = TRUE;
+	/* Worker output is merged in here, not on a thread. */
+	if (pd_farm_workers)
+		pd_annotations_flush();
+}
+
+/* Write samples to the session file, the decoders or the output format. */
+static void logic_write(struct dev_state *ds, const uint8_t *data,
+		uint64_t len)
+{
+	struct sr_output *o;
+	uint64_t output_len;
+	uint8_t *output_buf;
+	gint64 t;
+
+	o = ds->o;
+	if (ds->sfile) {
+		if (session_file_append(ds->sfile, data, len) != SR_OK)
+			stop_requested = TRUE;
+		ds->segment_bytes += len;
+	}
+
+	if (ds->output_file && default_output_format) {
+		/* saving to a session file, don't need to do anything else
+		 * to this data for now. */
+	} else if (ds->decode && !ds->athr) {
+		decode_send(ds->received_samples, data, len);
+	} else if (!ds->lstats) {
+		output_buf = NULL;
+		output_len = 0;
+		t = stats_start();
+		if (o->format->data && o->format->df_type == SR_DF_LOGIC)
+			o->format->data(o, data, len, &output_buf, &output_len);
+		stats_stop(STATS_OUTPUT, t);
+		if (output_buf)
+			output_put(ds, output_buf, output_len);
+	}
+}
+
+/* Only session files are saved with the lowered samplerate. */
+static void decimate_warn(struct dev_state *ds)
+{
+	if (!ds->output_file || !default_output_format)
+		g_warning("The %s output format shows the original "
+				"samplerate, not the decimated one.",
+				output_format->id);
+}
+
+/* Decimated samples make up a packet of their own for the output format. */
+static void decimated_out(struct dev_state *ds, const uint8_t *data,
+		uint64_t len)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+
+	if (len == 0)
+		return;
+
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.length = len;
+	logic.unitsize = ds->unitsize;
+	logic.data = (void *)data;
+	output_recv(ds, ds->sdi, &packet);
+	logic_write(ds, data, len);
+}
+
+/* Pass filtered logic samples on to the session file, decoders or output. */
+static void logic_out(struct dev_state *ds, const uint8_t *data, uint64_t len)
+{
+	uint64_t num_samples, output_len;
+	uint8_t *output_buf;
+	gint64 t;
+
+	num_samples = len / ds->unitsize;
+	if (ds->lstats) {
+		t = stats_start();
+		output_len = logic_stats_run(ds->lstats, data, len,
+				&output_buf);
+		stats_stop(STATS_OUTPUT, t);
+		if (output_buf)
+			summary_put(ds, output_buf, output_len);
+	}
+	if (ds->dec_logic) {
+		t = stats_start();
+		len = decimate_logic(ds->dec_logic, data, len, &data);
+		stats_stop(STATS_DECIMATE, t);
+		decimated_out(ds, data, len);
+	} else {
+		logic_write(ds, data, len);
+	}
+	ds->received_samples += num_samples;
+}
+
+/*
+ * The trigger fired: pass on the samples kept from before it, in order,
+ * as if they had just come in.
+ */
+static void pretrig_flush(struct dev_state *ds, const struct sr_dev_inst *sdi)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+	const uint8_t *data;
+	uint64_t len;
+
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	logic.unitsize = ds->unitsize;
+	while ((len = pretrig_get(ds->pretrig, &data))) {
+		if (ds->limit_samples) {
+			len = MIN(len, (ds->limit_samples - ds->received_samples)
+					* ds->unitsize);
+			if (len == 0)
+				break;
+		}
+		logic.length = len;
+		logic.data = (void *)data;
+		if (!ds->dec_logic)
+			output_recv(ds, sdi, &packet);
+		logic_out(ds, data, len);
+	}
+}
+
+/*
+ * The trigger fired, in hardware or in software. A software trigger has
+ * no packet of its own, so it gets a made-up one.
+ */
+static void trigger_fire(struct dev_state *ds, const struct sr_dev_inst *sdi,
+		gboolean synthetic)
+{
+	struct sr_datafeed_packet packet;
+	uint64_t output_len;
+	uint8_t *output_buf;
+
+	/* What came before the trigger goes out first. */
+	if (!ds->triggered && ds->pretrig)
+		pretrig_flush(ds, sdi);
+	if (ds->o->format->event) {
+		ds->o->format->event(ds->o, SR_DF_TRIGGER, &output_buf,
+				&output_len);
+		if (output_buf)
+			output_put(ds, output_buf, output_len);
+	}
+	if (synthetic) {
+		packet.type = SR_DF_TRIGGER;
+		packet.payload = NULL;
+		output_recv(ds, sdi, &packet);
+	}
+	ds->triggered = TRUE;
+}
+
+/* Check whether a device has had all the samples it's going to get. */
+static gboolean dev_limit_reached(struct dev_state *ds)
+{
+	if (ds->limit_reached)
+		return TRUE;
+
+	if (ds->limit_samples && ds->received_samples >= ds->limit_samples)
+		ds->limit_reached = TRUE;
+	else if (ds->limit_time && g_get_monotonic_time() - ds->acq_start
+			>= (gint64)ds->limit_time * 1000)
+		ds->limit_reached = TRUE;
+
+	return ds->limit_reached;
+}
+
+/* Check whether all running devices are done. */
+static gboolean all_limits_reached(void)
+{
+	GHashTableIter iter;
+	gpointer value;
+	struct dev_state *ds;
+
+	g_hash_table_iter_init(&iter, dev_states);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		ds = value;
+		if (ds->o && !dev_limit_reached(ds))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Number an output file, when -o is shared by more than one device or
+ * split into segments: "capture.sr" becomes "capture-1.sr".
+ */
+static char *dev_output_file(const char *filename, int index)
+{
+	const char *ext;
+
+	ext = strrchr(filename, '.');
+	if (!ext || strchr(ext, G_DIR_SEPARATOR))
+		return g_strdup_printf("%s-%d", filename, index);
+
+	return g_strdup_printf("%.*s-%d%s", (int)(ext - filename), filename,
+			index, ext);
+}
+
+/* With several input files, each gets an output file named after it. */
+static char *input_output_file(const char *filename, const char *input)
+{
+	const char *ext;
+	char *base, *s, *name;
+
+	base = g_path_get_basename(input);
+	if ((s = strrchr(base, '.')) && s != base)
+		*s = '\0';
+	ext = strrchr(filename, '.');
+	if (!ext || strchr(ext, G_DIR_SEPARATOR))
+		name = g_strdup_printf("%s-%s", filename, base);
+	else
+		name = g_strdup_printf("%.*s-%s%s", (int)(ext - filename),
+				filename, base, ext);
+	g_free(base);
+
+	return name;
+}
+
+/*
+ * Open where a device's output goes: stdout, a file in the output format,
+ * or a session file. With segments, it's a numbered file of its own.
+ */
+static void output_open(struct dev_state *ds, const struct sr_dev_inst *sdi)
+{
+	const char *filename;
+
+	filename = ds->output_file;
+	if (filename && (segment_size || segment_time)) {
+		if (!ds->segments && !(ds->segments = segments_new(
+				opt_segment_keep, segment_limit)))
+			exit(1);
+		g_free(ds->segment_file);
+		filename = ds->segment_file = dev_output_file(ds->output_file,
+				ds->segment);
+	}
+	ds->segment_bytes = 0;
+	ds->segment_start = g_get_monotonic_time();
+
+	ds->outfile = stdout;
+	if (filename) {
+		if (default_output_format) {
+			/* output file is in session format, which is
+			 * written out chunk by chunk as samples come in.
+			 * It can only hold logic data. */
+			ds->outfile = NULL;
+			if (ds->meta_type == SR_DF_META_LOGIC
+					&& !(ds->sfile = session_file_new(filename,
+					sdi, ds->unitsize,
+					ds->meta_logic.samplerate,
+					&ds->starttime)))
+				exit(1);
+		} else {
+			/* saving to a file in whatever format was set
+			 * with --format, so all we need is a filehandle */
+			if (!(ds->outfile = g_fopen(filename, "wb"))) {
+				g_critical("Failed to open %s: %s.", filename,
+						strerror(errno));
+				datafeed_failed = TRUE;
+				stop_requested = TRUE;
+			}
+		}
+	}
+	if (ds->outfile && !ds->writer
+			&& !(ds->writer = writer_new(ds->outfile,
+			flush_mode == FLUSH_TIME ? flush_arg : 0)))
+		exit(1);
+}
+
+/*
+ * Finish off whatever output_open() opened. Returns TRUE if that was a
+ * file.
+ */
+static gboolean output_close(struct dev_state *ds)
+{
+	gboolean file;
+
+	file = ds->sfile || (ds->outfile && ds->outfile != stdout);
+	if (ds->writer && writer_sync(ds->writer) != SR_OK)
+		datafeed_failed = TRUE;
+	writer_destroy(ds->writer);
+	ds->writer = NULL;
+	if (ds->sfile) {
+		if (session_file_close(ds->sfile) != SR_OK) {
+			g_critical("Failed to save session.");
+			datafeed_failed = TRUE;
+		}
+		ds->sfile = NULL;
+	}
+	ds->out_flush.bytes = 0;
+	if (ds->outfile && ds->outfile != stdout)
+		fclose(ds->outfile);
+	ds->outfile = NULL;
+
+	return file;
+}
+
+static gboolean segment_due(struct dev_state *ds)
+{
+	if (segment_size && ds->segment_bytes >= segment_size)
+		return TRUE;
+	if (segment_time && g_get_monotonic_time() - ds->segment_start
+			>= (gint64)segment_time * 1000)
+		return TRUE;
+
+	return FALSE;
+}
+
+/*
+ * Close the current segment and start the next. The output format is
+ * started over, so every segment has its own header and can be read on
+ * its own.
+ */
+static void segment_next(struct dev_state *ds, const struct sr_dev_inst *sdi)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_output *o;
+	uint64_t output_len;
+	uint8_t *output_buf;
+
+	o = ds->o;
+	g_debug("cli: Device %d starting segment %d.", ds->index,
+			ds->segment + 1);
+	if (o->format->event) {
+		o->format->event(o, SR_DF_END, &output_buf, &output_len);
+		if (output_buf)
+			output_put(ds, output_buf, output_len);
+	}
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+	output_recv(ds, sdi, &packet);
+	if (output_close(ds))
+		segments_add(ds->segments, ds->segment_file, segment_size,
+				TRUE);
+
+	if (o->format->cleanup)
+		o->format->cleanup(o);
+	if (o->format->init && o->format->init(o) != SR_OK) {
+		g_critical("Output format initialization failed.");
+		exit(1);
+	}
+	ds->segment++;
+	gettimeofday(&ds->starttime, NULL);
+	ds->header.starttime = ds->starttime;
+	output_open(ds, sdi);
+
+	/* Formats which take whole packets need to see these again. */
+	packet.type = SR_DF_HEADER;
+	packet.payload = &ds->header;
+	output_recv(ds, sdi, &packet);
+	packet.type = ds->meta_type;
+	if (ds->meta_type == SR_DF_META_LOGIC)
+		packet.payload = &ds->meta_logic;
+	else
+		packet.payload = &ds->meta_analog;
+	output_recv(ds, sdi, &packet);
+}
+
+/* The part of the input file to read, from --start and --end. */
+static int parse_window(uint64_t samplerate, uint64_t *start, uint64_t *end)
+{
+	*start = *end = 0;
+	if (opt_start && parse_sample_pos(opt_start, samplerate,
+			start) != SR_OK)
+		return SR_ERR;
+	if (opt_end && parse_sample_pos(opt_end, samplerate, end) != SR_OK)
+		return SR_ERR;
+	if (opt_end && *end <= *start) {
+		g_critical("The end must come after the start.");
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
 static void datafeed_in(const struct sr_dev_inst *sdi,
 		const struct sr_datafeed_packet *packet)
 {
-	static struct sr_output *o = NULL;
-	static int logic_probelist[SR_MAX_NUM_PROBES] = { -1 };
-	static struct sr_probe *analog_probelist[SR_MAX_NUM_PROBES];
-	static uint64_t received_samples = 0;
-	static int unitsize = 0;
-	static int triggered = 0;
-	static FILE *outfile = NULL;
-	static int num_analog_probes = 0;
+	struct dev_state *ds;
+	struct sr_output *o;
 	struct sr_probe *probe;
+	const struct sr_datafeed_header *header;
 	const struct sr_datafeed_logic *logic;
 	const struct sr_datafeed_meta_logic *meta_logic;
 	const struct sr_datafeed_analog *analog;
 	const struct sr_datafeed_meta_analog *meta_analog;
-	static int num_enabled_analog_probes = 0;
-	int num_enabled_probes, sample_size, ret, i;
+	const float *analog_data;
+	float levels[SR_MAX_NUM_PROBES], hysteresis[SR_MAX_NUM_PROBES];
+	char **names;
+	int num_enabled_probes, sample_size, ret, i, j;
 	uint64_t output_len, filter_out_len;
-	uint8_t *output_buf, *filter_out;
-	GString *out;
+	uint8_t *output_buf;
+	const uint8_t *filter_out;
+	const struct sr_datafeed_packet *out_packet;
+	struct sr_datafeed_packet trimmed_packet;
+	struct sr_datafeed_logic trimmed_logic;
+	struct sr_datafeed_analog trimmed_analog;
+	uint64_t num_samples, pre_len, skip, start, end, interval;
+	int64_t trig;
+	gint64 t_packet, t;
+
+	t_packet = stats_start();
+	stats_poll();
+	if (packet->type == SR_DF_LOGIC)
+		stats_packet(packet->type,
+			((const struct sr_datafeed_logic *)packet->payload)->length);
+	else if (packet->type == SR_DF_ANALOG)
+		stats_packet(packet->type, sizeof(float) *
+			((const struct sr_datafeed_analog *)packet->payload)->num_samples);
+	else
+		stats_packet(packet->type, 0);
+
+	ds = dev_state_get(sdi);
+	o = ds->o;
 
 	/* If the first packet to come in isn't a header, don't even try. */
 	if (packet->type != SR_DF_HEADER && o == NULL)
 		return;
 
+	/* Handed to the output format, unless dropped or trimmed below. */
+	out_packet = packet;
 	sample_size = -1;
 	switch (packet->type) {
 	case SR_DF_HEADER:
 		g_debug("cli: Received SR_DF_HEADER");
+		header = packet->payload;
+		ds->header = *header;
+		ds->starttime = header->starttime;
+		ds->acq_start = g_get_monotonic_time();
+		ds->limit_reached = FALSE;
+		if (session_start.tv_sec)
+			g_debug("cli: Device %d started %+.3f ms after the "
+					"session.", ds->index,
+					(header->starttime.tv_sec - session_start.tv_sec)
+					* 1000.0 + (header->starttime.tv_usec
+					- session_start.tv_usec) / 1000.0);
 		/* Initialize the output module. */
 		if (!(o = g_try_malloc(sizeof(struct sr_output)))) {
 			g_critical("Output module malloc failed.");
@@ -583,44 +1348,91 @@ static void datafeed_in(const struct sr_dev_inst *sdi,
 				exit(1);
 			}
 		}
+		ds->o = o;
+		ds->out_flush.last = g_get_monotonic_time();
+		if (ds->decode)
+			ann_flush.last = ds->out_flush.last;
+		devs_running++;
 		break;
 
 	case SR_DF_END:
 		g_debug("cli: Received SR_DF_END");
-		if (!o) {
-			g_debug("cli: double end!");
-			break;
+		/* The last window may not have been full. */
+		if (ds->dec_logic && (filter_out_len = decimate_logic_flush(
+				ds->dec_logic, &filter_out)))
+			decimated_out(ds, filter_out, filter_out_len);
+		if (ds->astats && (output_len = analog_stats_flush(ds->astats,
+				&output_buf))) {
+			summary_put(ds, output_buf, output_len);
+			output_len = 0;
+		}
+		if (ds->lstats && (output_len = logic_stats_flush(ds->lstats,
+				&output_buf))) {
+			summary_put(ds, output_buf, output_len);
+			output_len = 0;
 		}
 		if (o->format->event) {
 			o->format->event(o, SR_DF_END, &output_buf, &output_len);
 			if (output_buf) {
-				if (outfile)
-					fwrite(output_buf, 1, output_len, outfile);
-				g_free(output_buf);
+				output_put(ds, output_buf, output_len);
 				output_len = 0;
 			}
 		}
-		if (limit_samples && received_samples < limit_samples)
+		if (ds->limit_samples && ds->received_samples < ds->limit_samples)
 			g_warning("Device only sent %" PRIu64 " samples.",
-			       received_samples);
+			       ds->received_samples);
 		if (opt_continuous)
 			g_warning("Device stopped after %" PRIu64 " samples.",
-			       received_samples);
-		if (outfile && outfile != stdout)
-			fclose(outfile);
+			       ds->received_samples);
+		devs_running--;
+		/* Let the decoders catch up before the final flush. */
+		if (ds->decode) {
+			if (pd_farm_workers)
+				ret = pd_farm_session_end();
+			else
+				ret = pd_queue_end();
+			if (ret != SR_OK) {
+				g_critical("Protocol decoding failed.");
+				datafeed_failed = TRUE;
+			}
+		}
+		/* Wait for the writer, so its last fwrite() is in the stats. */
+		if (output_close(ds) && ds->segments && ds->segment_file)
+			segments_add(ds->segments, ds->segment_file, 0, FALSE);
+		if (devs_running == 0)
+			stats_print();
+		if (ds->decode) {
+			g_mutex_lock(&ann_flush_mutex);
+			ann_write(TRUE);
+			ann_flush.bytes = 0;
+			g_mutex_unlock(&ann_flush_mutex);
+		}
 
 		if (o->format->cleanup)
 			o->format->cleanup(o);
 		g_free(o);
-		o = NULL;
+		ds->o = o = NULL;
+		probe_filter_destroy(ds->pf);
+		ds->pf = NULL;
+		analog_filter_destroy(ds->af);
+		ds->af = NULL;
+		pretrig_destroy(ds->pretrig);
+		ds->pretrig = NULL;
+		decimator_destroy(ds->dec_logic);
+		ds->dec_logic = NULL;
+		decimator_destroy(ds->dec_analog);
+		ds->dec_analog = NULL;
+		analog_stats_destroy(ds->astats);
+		ds->astats = NULL;
+		threshold_destroy(ds->athr);
+		ds->athr = NULL;
+		logic_stats_destroy(ds->lstats);
+		ds->lstats = NULL;
 		break;
 
 	case SR_DF_TRIGGER:
 		g_debug("cli: received SR_DF_TRIGGER");
-		if (o->format->event)
-			o->format->event(o, SR_DF_TRIGGER, &output_buf,
-					 &output_len);
-		triggered = 1;
+		trigger_fire(ds, sdi, FALSE);
 		break;
 
 	case SR_DF_META_LOGIC:
@@ -630,32 +1442,68 @@ static void datafeed_in(const struct sr_dev_inst *sdi,
 		for (i = 0; i < meta_logic->num_probes; i++) {
 			probe = g_slist_nth_data(sdi->probes, i);
 			if (probe->enabled)
-				logic_probelist[num_enabled_probes++] = probe->index;
+				ds->logic_probelist[num_enabled_probes++] = probe->index;
 		}
-		logic_probelist[num_enabled_probes] = -1;
+		ds->logic_probelist[num_enabled_probes] = -1;
 		/* How many bytes we need to store num_enabled_probes bits */
-		unitsize = (num_enabled_probes + 7) / 8;
-
-		outfile = stdout;
-		if (opt_output_file) {
-			if (default_output_format) {
-				/* output file is in session format, which means we'll
-				 * dump everything in the datastore as it comes in,
-				 * and save from there after the session. */
-				outfile = NULL;
-				ret = sr_datastore_new(unitsize, &singleds);
-				if (ret != SR_OK) {
-					g_critical("Failed to create datastore.");
+		ds->unitsize = (num_enabled_probes + 7) / 8;
+
+		/* Without a way to seek, the window is cut out of the whole
+		 * file as it comes in. */
+		if ((opt_start || opt_end) && !window_read) {
+			if (parse_window(meta_logic->samplerate, &start,
+					&end) != SR_OK)
+				exit(1);
+			ds->skip_samples = start;
+			if (end && (!ds->limit_samples
+					|| end - start < ds->limit_samples))
+				ds->limit_samples = end - start;
+		}
+
+		if (opt_logic_stats && !ds->lstats) {
+			interval = 0;
+			if (opt_logic_stats_interval && parse_sample_pos(
+					opt_logic_stats_interval,
+					meta_logic->samplerate, &interval) != SR_OK)
+				exit(1);
+			names = g_malloc0((num_enabled_probes + 1)
+					* sizeof(char *));
+			for (i = 0, j = 0; i < meta_logic->num_probes; i++) {
+				probe = g_slist_nth_data(sdi->probes, i);
+				if (probe->enabled)
+					names[j++] = probe->name;
+			}
+			ds->lstats = logic_stats_new(names, ds->unitsize,
+					meta_logic->samplerate, interval);
+			g_free(names);
+			if (!ds->lstats)
+				exit(1);
+		}
+
+		ds->meta_type = SR_DF_META_LOGIC;
+		ds->meta_logic = *meta_logic;
+		/* Decoders need every sample, so decimation is only for
+		 * output. */
+		if (decimate_factor && !ds->decode) {
+			if (!ds->dec_logic) {
+				if (!(ds->dec_logic = decimator_new(
+						decimate_factor, decimate_mode,
+						ds->unitsize)))
 					exit(1);
-				}
-			} else {
-				/* saving to a file in whatever format was set
-				 * with --format, so all we need is a filehandle */
-				outfile = g_fopen(opt_output_file, "wb");
+				decimate_warn(ds);
 			}
+			ds->meta_logic.samplerate /= decimate_factor;
+			trimmed_packet.type = SR_DF_META_LOGIC;
+			trimmed_packet.payload = &ds->meta_logic;
+			out_packet = &trimmed_packet;
 		}
-		if (opt_pds)
-			srd_session_start(num_enabled_probes, unitsize,
+		output_open(ds, sdi);
+		if (opt_wait_trigger && pre_trigger && !ds->pretrig
+				&& !(ds->pretrig = pretrig_new(pre_trigger,
+				ds->unitsize)))
+			exit(1);
+		if (ds->decode && !ds->athr)
+			decode_start(num_enabled_probes, ds->unitsize,
 					meta_logic->samplerate);
 		break;
 
@@ -666,86 +1514,194 @@ static void datafeed_in(const struct sr_dev_inst *sdi,
 		if (logic->length == 0)
 			break;
 
+		num_samples = logic->length / sample_size;
+
+		if (ds->skip_samples) {
+			skip = MIN(ds->skip_samples, num_samples);
+			ds->skip_samples -= skip;
+			if ((num_samples -= skip) == 0) {
+				out_packet = NULL;
+				break;
+			}
+			trimmed_logic = *logic;
+			trimmed_logic.data = (uint8_t *)logic->data
+					+ skip * sample_size;
+			trimmed_logic.length = num_samples * sample_size;
+			trimmed_packet.type = SR_DF_LOGIC;
+			trimmed_packet.payload = &trimmed_logic;
+			out_packet = &trimmed_packet;
+			logic = &trimmed_logic;
+		}
+
 		/* Don't store any samples until triggered. */
-		if (opt_wait_trigger && !triggered)
+		if (opt_wait_trigger && !ds->triggered && !ds->pretrig
+				&& !ds->swtrig) {
+			stats_drop(STATS_DROP_TRIGGER, num_samples);
+			out_packet = NULL;
 			break;
+		}
+
+		if (dev_limit_reached(ds)) {
+			stats_drop(STATS_DROP_LIMIT, num_samples);
+			out_packet = NULL;
+			break;
+		}
 
-		if (limit_samples && received_samples >= limit_samples)
+		/* The driver may well send more than was asked for: only
+		 * keep samples up to the limit, to the exact sample. */
+		if (ds->limit_samples && (!opt_wait_trigger || ds->triggered)
+				&& ds->received_samples + num_samples
+				> ds->limit_samples) {
+			stats_drop(STATS_DROP_LIMIT, ds->received_samples
+					+ num_samples - ds->limit_samples);
+			num_samples = ds->limit_samples - ds->received_samples;
+			trimmed_logic = *logic;
+			trimmed_logic.length = num_samples * sample_size;
+			trimmed_packet.type = SR_DF_LOGIC;
+			trimmed_packet.payload = &trimmed_logic;
+			out_packet = &trimmed_packet;
+		}
+
+		/* The filter is set up for the first packet's unitsize, and
+		 * only needs rebuilding if the driver changes it. */
+		if (ds->pf && probe_filter_in_unitsize_get(ds->pf) != sample_size) {
+			probe_filter_destroy(ds->pf);
+			ds->pf = NULL;
+		}
+		if (!ds->pf && !(ds->pf = probe_filter_new(sample_size,
+				ds->unitsize, ds->logic_probelist)))
 			break;
 
-		ret = sr_filter_probes(sample_size, unitsize, logic_probelist,
-				logic->data, logic->length,
-				&filter_out, &filter_out_len);
+		t = stats_start();
+		ret = probe_filter_run(ds->pf, logic->data,
+				num_samples * sample_size, &filter_out,
+				&filter_out_len);
+		stats_stop(STATS_FILTER, t);
 		if (ret != SR_OK)
 			break;
 
-		/* what comes out of the filter is guaranteed to be packed into the
-		 * minimum size needed to support the number of samples at this sample
-		 * size. however, the driver may have submitted too much -- cut off
-		 * the buffer of the last packet according to the sample limit.
+		/*
+		 * A software trigger fires on a sample somewhere in the middle
+		 * of the packet: what comes before it is pre-trigger data, and
+		 * the rest goes on as if it were a packet of its own.
 		 */
-		if (limit_samples && (received_samples + logic->length / sample_size >
-				limit_samples * sample_size))
-			filter_out_len = limit_samples * sample_size - received_samples;
-
-		if (singleds)
-			sr_datastore_put(singleds, filter_out,
-					filter_out_len, sample_size, logic_probelist);
-
-		if (opt_output_file && default_output_format)
-			/* saving to a session file, don't need to do anything else
-			 * to this data for now. */
-			goto cleanup;
-
-		if (opt_pds) {
-			if (srd_session_send(received_samples, (uint8_t*)filter_out,
-					filter_out_len) != SRD_OK)
-				sr_session_stop();
-		} else {
-			output_len = 0;
-			if (o->format->data && packet->type == o->format->df_type)
-				o->format->data(o, filter_out, filter_out_len, &output_buf, &output_len);
-			if (output_buf) {
-				fwrite(output_buf, 1, output_len, outfile);
-				fflush(outfile);
-				g_free(output_buf);
+		if (ds->swtrig && !ds->triggered && (trig = swtrig_find(ds->swtrig,
+				filter_out, filter_out_len)) >= 0) {
+			pre_len = trig * ds->unitsize;
+			if (!opt_wait_trigger) {
+				trimmed_logic = *logic;
+				trimmed_logic.length = trig * sample_size;
+				trimmed_packet.type = SR_DF_LOGIC;
+				trimmed_packet.payload = &trimmed_logic;
+				if (!ds->dec_logic)
+					output_recv(ds, sdi, &trimmed_packet);
+				logic_out(ds, filter_out, pre_len);
+			} else if (ds->pretrig) {
+				stats_drop(STATS_DROP_TRIGGER, pretrig_put(ds->pretrig,
+						filter_out, pre_len) / ds->unitsize);
+			} else {
+				stats_drop(STATS_DROP_TRIGGER, trig);
+			}
+			trigger_fire(ds, sdi, TRUE);
+
+			filter_out += pre_len;
+			filter_out_len -= pre_len;
+			num_samples -= trig;
+			/* The limit wasn't applied while waiting for it. */
+			if (ds->limit_samples && ds->received_samples
+					+ num_samples > ds->limit_samples) {
+				stats_drop(STATS_DROP_LIMIT, ds->received_samples
+						+ num_samples - ds->limit_samples);
+				num_samples = ds->limit_samples
+						- ds->received_samples;
+				filter_out_len = num_samples * ds->unitsize;
 			}
+			trimmed_logic = *logic;
+			trimmed_logic.data = (uint8_t *)logic->data
+					+ trig * sample_size;
+			trimmed_logic.length = num_samples * sample_size;
+			trimmed_packet.type = SR_DF_LOGIC;
+			trimmed_packet.payload = &trimmed_logic;
+			out_packet = &trimmed_packet;
+		}
+
+		/* Until the trigger fires, only the latest samples are kept. */
+		if (opt_wait_trigger && !ds->triggered) {
+			if (ds->pretrig)
+				stats_drop(STATS_DROP_TRIGGER, pretrig_put(
+						ds->pretrig, filter_out,
+						filter_out_len) / ds->unitsize);
+			else
+				stats_drop(STATS_DROP_TRIGGER, num_samples);
+			out_packet = NULL;
+			break;
 		}
 
-		cleanup:
-		g_free(filter_out);
-		received_samples += logic->length / sample_size;
+		/* Decimated samples get to the output format on their own. */
+		if (ds->dec_logic)
+			out_packet = NULL;
+		logic_out(ds, filter_out, filter_out_len);
 		break;
 
 	case SR_DF_META_ANALOG:
 		g_message("cli: Received SR_DF_META_ANALOG");
 		meta_analog = packet->payload;
-		num_analog_probes = meta_analog->num_probes;
-		num_enabled_analog_probes = 0;
-		for (i = 0; i < num_analog_probes; i++) {
+		ds->num_analog_probes = meta_analog->num_probes;
+		ds->num_enabled_analog_probes = 0;
+		for (i = 0; i < ds->num_analog_probes; i++) {
 			probe = g_slist_nth_data(sdi->probes, i);
 			if (probe->enabled)
-				analog_probelist[num_enabled_analog_probes++] = probe;
-		}
-
-		outfile = stdout;
-		if (opt_output_file) {
-			if (default_output_format) {
-				/* output file is in session format, which means we'll
-				 * dump everything in the datastore as it comes in,
-				 * and save from there after the session. */
-				outfile = NULL;
-				ret = sr_datastore_new(unitsize, &singleds);
-				if (ret != SR_OK) {
-					g_critical("Failed to create datastore.");
-					exit(1);
-				}
+				ds->analog_probelist[ds->num_enabled_analog_probes++] = i;
+		}
+		ds->analog_probelist[ds->num_enabled_analog_probes] = -1;
+		analog_filter_destroy(ds->af);
+		if (!(ds->af = analog_filter_new(ds->analog_probelist,
+				ds->num_analog_probes)))
+			exit(1);
+		names = g_malloc0((ds->num_enabled_analog_probes + 1)
+				* sizeof(char *));
+		for (i = 0; i < ds->num_enabled_analog_probes; i++) {
+			probe = g_slist_nth_data(sdi->probes,
+					ds->analog_probelist[i]);
+			names[i] = probe->name;
+		}
+		if (analog_stats_window && !ds->astats && !(ds->astats =
+				analog_stats_new(analog_stats_window, names)))
+			exit(1);
+		/* Decoders get the analog probes, unless the device has
+		 * logic probes for them. */
+		if (ds->decode && !ds->athr && !ds->unitsize) {
+			if (!opt_analog_threshold) {
+				g_warning("Analog probes can only be decoded "
+						"with --analog-threshold.");
+			} else if (parse_thresholds(opt_analog_threshold,
+					names, levels, hysteresis) != SR_OK
+					|| !(ds->athr = threshold_new(levels,
+					hysteresis,
+					ds->num_enabled_analog_probes))) {
+				exit(1);
 			} else {
-				/* saving to a file in whatever format was set
-				 * with --format, so all we need is a filehandle */
-				outfile = g_fopen(opt_output_file, "wb");
+				decode_start(ds->num_enabled_analog_probes,
+						threshold_unitsize_get(ds->athr),
+						dev_samplerate(sdi));
 			}
 		}
+		g_free(names);
+
+		if (ds->output_file && default_output_format)
+			g_warning("Analog data can't be saved in the "
+					"session format, use -O to pick "
+					"another output format.");
+		ds->meta_type = SR_DF_META_ANALOG;
+		ds->meta_analog = *meta_analog;
+		if (decimate_factor && !ds->dec_analog) {
+			if (!(ds->dec_analog = decimator_new(decimate_factor,
+					decimate_mode,
+					MAX(ds->num_enabled_analog_probes, 1))))
+				exit(1);
+			decimate_warn(ds);
+		}
+		output_open(ds, sdi);
 		break;
 
 	case SR_DF_ANALOG:
@@ -754,21 +1710,84 @@ static void datafeed_in(const struct sr_dev_inst *sdi,
 		if (analog->num_samples == 0)
 			break;
 
-		if (limit_samples && received_samples >= limit_samples)
+		if (dev_limit_reached(ds)) {
+			stats_drop(STATS_DROP_LIMIT, analog->num_samples);
+			out_packet = NULL;
 			break;
+		}
 
-		if (o->format->data && packet->type == o->format->df_type) {
-			o->format->data(o, (const uint8_t *)analog->data,
-					analog->num_samples * sizeof(float),
-					&output_buf, &output_len);
-			if (output_buf) {
-				fwrite(output_buf, 1, output_len, outfile);
-				fflush(outfile);
-				g_free(output_buf);
-			}
+		num_samples = analog->num_samples;
+		if (ds->limit_samples && ds->received_samples + num_samples
+				> ds->limit_samples) {
+			stats_drop(STATS_DROP_LIMIT, ds->received_samples
+					+ num_samples - ds->limit_samples);
+			num_samples = ds->limit_samples - ds->received_samples;
+			trimmed_analog = *analog;
+			trimmed_analog.num_samples = num_samples;
+			trimmed_packet.type = SR_DF_ANALOG;
+			trimmed_packet.payload = &trimmed_analog;
+			out_packet = &trimmed_packet;
 		}
+		ds->received_samples += num_samples;
 
-		received_samples += analog->num_samples;
+		/* Only the enabled probes' values go on. */
+		if (ds->num_enabled_analog_probes == 0) {
+			out_packet = NULL;
+			break;
+		}
+		t = stats_start();
+		ret = analog_filter_run(ds->af, analog->data, num_samples,
+				&analog_data);
+		stats_stop(STATS_FILTER, t);
+		if (ret != SR_OK)
+			break;
+		if (ds->athr) {
+			/* As with logic samples, decoding takes the place
+			 * of output. */
+			t = stats_start();
+			ret = threshold_run(ds->athr, analog_data, num_samples,
+					&filter_out, &filter_out_len);
+			stats_stop(STATS_FILTER, t);
+			if (ret == SR_OK)
+				decode_send(ds->received_samples - num_samples,
+						filter_out, filter_out_len);
+			out_packet = NULL;
+			break;
+		}
+		if (ds->astats) {
+			/* Statistics take the place of the samples. */
+			t = stats_start();
+			output_len = analog_stats_run(ds->astats, analog_data,
+					num_samples, &output_buf);
+			stats_stop(STATS_OUTPUT, t);
+			if (output_buf)
+				summary_put(ds, output_buf, output_len);
+			out_packet = NULL;
+			break;
+		}
+		if (ds->dec_analog) {
+			t = stats_start();
+			num_samples = decimate_analog(ds->dec_analog, analog_data,
+					num_samples, &analog_data);
+			stats_stop(STATS_DECIMATE, t);
+		}
+		trimmed_analog = *analog;
+		trimmed_analog.num_samples = num_samples;
+		trimmed_analog.data = (float *)analog_data;
+		trimmed_packet.type = SR_DF_ANALOG;
+		trimmed_packet.payload = &trimmed_analog;
+		out_packet = num_samples ? &trimmed_packet : NULL;
+
+		if (o->format->data && packet->type == o->format->df_type
+				&& num_samples) {
+			t = stats_start();
+			o->format->data(o, (const uint8_t *)analog_data,
+					num_samples * ds->num_enabled_analog_probes
+					* sizeof(float), &output_buf, &output_len);
+			stats_stop(STATS_OUTPUT, t);
+			if (output_buf)
+				output_put(ds, output_buf, output_len);
+		}
 		break;
 
 	case SR_DF_FRAME_BEGIN:
@@ -776,11 +1795,8 @@ static void datafeed_in(const struct sr_dev_inst *sdi,
 		if (o->format->event) {
 			o->format->event(o, SR_DF_FRAME_BEGIN, &output_buf,
 					 &output_len);
-			if (output_buf) {
-				fwrite(output_buf, 1, output_len, outfile);
-				fflush(outfile);
-				g_free(output_buf);
-			}
+			if (output_buf)
+				output_put(ds, output_buf, output_len);
 		}
 		break;
 
@@ -789,11 +1805,8 @@ static void datafeed_in(const struct sr_dev_inst *sdi,
 		if (o->format->event) {
 			o->format->event(o, SR_DF_FRAME_END, &output_buf,
 					 &output_len);
-			if (output_buf) {
-				fwrite(output_buf, 1, output_len, outfile);
-				fflush(outfile);
-				g_free(output_buf);
-			}
+			if (output_buf)
+				output_put(ds, output_buf, output_len);
 		}
 		break;
 
@@ -801,14 +1814,32 @@ static void datafeed_in(const struct sr_dev_inst *sdi,
 		g_message("received unknown packet type %d", packet->type);
 	}
 
-	if (o && o->format->recv) {
-		out = o->format->recv(o, sdi, packet);
-		if (out && out->len) {
-			fwrite(out->str, 1, out->len, outfile);
-			fflush(outfile);
-		}
-	}
+	if (o && out_packet)
+		output_recv(ds, sdi, out_packet);
+
+	/* Segments end on packet boundaries. */
+	if (o && ds->segments && (packet->type == SR_DF_LOGIC
+			|| packet->type == SR_DF_ANALOG) && segment_due(ds))
+		segment_next(ds, sdi);
 
+	if (ds->writer && flush_due(&ds->out_flush))
+		writer_flush(ds->writer);
+
+	stats_stop(STATS_PACKET, t_packet);
+
+	/*
+	 * Stop as soon as every device has all it needs, rather than wait
+	 * for the drivers to notice. This must come last: drivers may send
+	 * SR_DF_END from within sr_session_stop().
+	 */
+	if (o && dev_limit_reached(ds) && all_limits_reached())
+		stop_requested = TRUE;
+	if (stop_requested && session_running) {
+		stop_requested = FALSE;
+		session_running = FALSE;
+		g_debug("cli: Stopping the session.");
+		sr_session_stop();
+	}
 }
 
 /* Register the given PDs for this session.
@@ -826,7 +1857,7 @@ static int register_pds(struct sr_dev *dev, const char *pdstring)
 	(void)dev;
 
 	ret = 0;
-	pd_ann_visible = g_hash_table_new_full(g_str_hash, g_int_equal,
+	pd_ann_visible = g_hash_table_new_full(g_str_hash, g_str_equal,
 			g_free, NULL);
 	pd_name = NULL;
 	pd_opthash = NULL;
@@ -856,7 +1887,7 @@ static int register_pds(struct sr_dev *dev, const char *pdstring)
 		 */
 		if (!opt_pd_annotations)
 			g_hash_table_insert(pd_ann_visible,
-					    g_strdup(di->inst_id), NULL);
+					    g_strdup(di->inst_id), GUINT_TO_POINTER(1));
 
 		/* Any keys left in the options hash are probes, where the key
 		 * is the probe name as specified in the decoder class, and the
@@ -888,7 +1919,7 @@ int setup_pd_stack(void)
 
 	/* Set up the protocol decoder stack. */
 	pds = g_strsplit(opt_pds, ",", 0);
-	if (g_strv_length(pds) > 1) {
+	if (g_strv_length(pds) > 1 && (opt_pd_stack || pd_autostack)) {
 		if (opt_pd_stack) {
 			/* A stack setup was specified, use that. */
 			g_strfreev(pds);
@@ -943,14 +1974,14 @@ int setup_pd_annotations(void)
 {
 	GSList *l;
 	struct srd_decoder *dec;
+	guint mask;
 	int ann;
-	char **pds, **pdtok, **keyval, **ann_descr;
+	char **pds, **pdtok, **keyval, **anns, **anntok, **ann_descr;
 
 	/* Set up custom list of PDs and annotations to show. */
 	if (opt_pd_annotations) {
 		pds = g_strsplit(opt_pd_annotations, ",", 0);
 		for (pdtok = pds; *pdtok && **pdtok; pdtok++) {
-			ann = 0;
 			keyval = g_strsplit(*pdtok, "=", 0);
 			if (!(dec = srd_decoder_get_by_id(keyval[0]))) {
 				g_critical("Protocol decoder '%s' not found.", keyval[0]);
@@ -960,21 +1991,36 @@ int setup_pd_annotations(void)
 				g_critical("Protocol decoder '%s' has no annotations.", keyval[0]);
 				return 1;
 			}
+			/* Without a list, the first annotation class is shown. */
+			mask = 1;
 			if (g_strv_length(keyval) == 2) {
-				for (l = dec->annotations; l; l = l->next, ann++) {
-					ann_descr = l->data;
-					if (!canon_cmp(ann_descr[0], keyval[1]))
-						/* Found it. */
-						break;
-				}
-				if (!l) {
-					g_critical("Annotation '%s' not found "
-							"for protocol decoder '%s'.", keyval[1], keyval[0]);
-					return 1;
+				mask = 0;
+				anns = g_strsplit(keyval[1], ":", 0);
+				for (anntok = anns; *anntok; anntok++) {
+					ann = 0;
+					for (l = dec->annotations; l; l = l->next, ann++) {
+						ann_descr = l->data;
+						if (!canon_cmp(ann_descr[0], *anntok))
+							/* Found it. */
+							break;
+					}
+					if (!l) {
+						g_critical("Annotation '%s' not found "
+								"for protocol decoder '%s'.", *anntok, keyval[0]);
+						return 1;
+					}
+					if (ann >= 32) {
+						g_critical("Only the first 32 annotations of "
+								"protocol decoder '%s' can be shown.",
+								keyval[0]);
+						return 1;
+					}
+					g_debug("cli: showing protocol decoder annotation %d from '%s'", ann, keyval[0]);
+					mask |= 1U << ann;
 				}
+				g_strfreev(anns);
 			}
-			g_debug("cli: showing protocol decoder annotation %d from '%s'", ann, keyval[0]);
-			g_hash_table_insert(pd_ann_visible, g_strdup(keyval[0]), GINT_TO_POINTER(ann));
+			g_hash_table_insert(pd_ann_visible, g_strdup(keyval[0]), GUINT_TO_POINTER(mask));
 			g_strfreev(keyval);
 		}
 		g_strfreev(pds);
@@ -990,7 +2036,7 @@ int setup_output_format(void)
 	gpointer key, value;
 	struct sr_output_format **outputs;
 	int i;
-	char *fmtspec;
+	char *fmtspec, *val;
 
 	if (!opt_output_format) {
 		opt_output_format = DEFAULT_OUTPUT_FORMAT;
@@ -1006,8 +2052,16 @@ int setup_output_format(void)
 		g_critical("Invalid output format.");
 		return 1;
 	}
+	/* The CLI's own formats get all their options, as they were
+	 * given. */
+	if (!strcmp(fmtspec, output_transitions.id))
+		output_format = &output_transitions;
+	else if (!strcmp(fmtspec, output_analog_bin.id))
+		output_format = &output_analog_bin;
+	if (output_format && (val = strchr(opt_output_format, ':')))
+		output_format_param = g_strdup(val + 1);
 	outputs = sr_output_list();
-	for (i = 0; outputs[i]; i++) {
+	for (i = 0; outputs[i] && !output_format; i++) {
 		if (strcmp(outputs[i]->id, fmtspec))
 			continue;
 		g_hash_table_remove(fmtargs, "sigrok_key");
@@ -1030,46 +2084,153 @@ int setup_output_format(void)
 	return 0;
 }
 
+static void print_pd_annotation(const char *line, gsize len)
+{
+	g_mutex_lock(&ann_flush_mutex);
+	if (!ann_buf)
+		ann_buf = g_string_sized_new(ANN_BUFSIZE);
+	g_string_append_len(ann_buf, line, len);
+	ann_flush.bytes += len;
+	/* With the packet policy, that's after every block of samples. */
+	if (flush_mode != FLUSH_PACKET && flush_due(&ann_flush))
+		ann_write(TRUE);
+	else if (ann_buf->len >= ANN_BUFSIZE)
+		ann_write(FALSE);
+	g_mutex_unlock(&ann_flush_mutex);
+}
+
+/**
+ * Write out annotations if the flush policy says so. Called after each
+ * block of samples has been decoded.
+ */
+void pd_annotations_flush(void)
+{
+	g_mutex_lock(&ann_flush_mutex);
+	if (flush_due(&ann_flush))
+		ann_write(TRUE);
+	g_mutex_unlock(&ann_flush_mutex);
+}
+
 void show_pd_annotations(struct srd_proto_data *pdata, void *cb_data)
 {
-	int i;
-	char **annotations;
-	gpointer ann_format;
+	static GString *line = NULL;
+	static const struct srd_pd_output *last_pdo = NULL;
+	static guint last_mask = 0;
+	gpointer mask;
+	gint64 t;
 
 	/* 'cb_data' is not used in this specific callback. */
 	(void)cb_data;
 
-	if (!pd_ann_visible)
+	/* Benchmarks measure the decoders, not the terminal. */
+	if (!pd_ann_visible || opt_benchmark)
 		return;
 
-	if (!g_hash_table_lookup_extended(pd_ann_visible, pdata->pdo->di->inst_id,
-			NULL, &ann_format))
-		/* Not in the list of PDs whose annotations we're showing. */
-		return;
+	/*
+	 * Only ever called from one thread. Which annotations a decoder
+	 * output shows is looked up by instance ID only the first time
+	 * around, and annotations tend to come from the same one in a row.
+	 */
+	if (pdata->pdo != last_pdo) {
+		if (!pd_ann_masks)
+			pd_ann_masks = g_hash_table_new(g_direct_hash,
+					g_direct_equal);
+		if (!g_hash_table_lookup_extended(pd_ann_masks, pdata->pdo,
+				NULL, &mask)) {
+			/* Not in the list: none of its annotations are shown. */
+			mask = g_hash_table_lookup(pd_ann_visible,
+					pdata->pdo->di->inst_id);
+			g_hash_table_insert(pd_ann_masks, pdata->pdo, mask);
+		}
+		last_pdo = pdata->pdo;
+		last_mask = GPOINTER_TO_UINT(mask);
+	}
 
-	if (pdata->ann_format != GPOINTER_TO_INT(ann_format))
+	if (pdata->ann_format >= 32 || !(last_mask & (1U << pdata->ann_format)))
 		/* We don't want this particular format from the PD. */
 		return;
 
-	annotations = pdata->data;
-	if (opt_loglevel > SR_LOG_WARN)
-		printf("%"PRIu64"-%"PRIu64" ", pdata->start_sample, pdata->end_sample);
-	printf("%s: ", pdata->pdo->proto_id);
-	for (i = 0; annotations[i]; i++)
-		printf("\"%s\" ", annotations[i]);
-	printf("\n");
-	fflush(stdout);
+	t = stats_start();
+
+	if (!line)
+		line = g_string_sized_new(256);
+	g_string_truncate(line, 0);
+	ann_format_record(line, pd_ann_format, pdata,
+			opt_loglevel > SR_LOG_WARN);
+
+	/* Worker processes pass them on to be printed in order. */
+	if (pd_farm_worker)
+		pd_farm_annotation(line->str, line->len);
+	else
+		print_pd_annotation(line->str, line->len);
+
+	stats_stop(STATS_ANNOTATION, t);
+}
+
+static int setup_pds(void)
+{
+	if (srd_init(NULL) != SRD_OK)
+		return 1;
+	if (register_pds(NULL, opt_pds) != 0)
+		return 1;
+	if (srd_pd_output_callback_add(SRD_OUTPUT_ANN,
+			show_pd_annotations, NULL) != SRD_OK)
+		return 1;
+	if (setup_pd_stack() != 0)
+		return 1;
+	if (setup_pd_annotations() != 0)
+		return 1;
+
+	return 0;
+}
+
+/* Set up only the given decoders, in a protocol decoder worker process. */
+static int setup_pd_worker(const char *pds, const char *stack)
+{
+	GString *anns;
+	char **pdtokens, **anntokens, **pdtok, **anntok;
+	int len;
+
+	pd_farm_worker = TRUE;
+	pd_autostack = FALSE;
+	opt_pds = g_strdup(pds);
+	opt_pd_stack = stack ? g_strdup(stack) : NULL;
+
+	/* Only keep the -A entries for decoders this worker runs. */
+	if (opt_pd_annotations) {
+		anns = g_string_new("");
+		pdtokens = g_strsplit(pds, ",", 0);
+		anntokens = g_strsplit(opt_pd_annotations, ",", 0);
+		for (anntok = anntokens; *anntok; anntok++) {
+			len = strcspn(*anntok, "=");
+			for (pdtok = pdtokens; *pdtok; pdtok++) {
+				if ((int)strcspn(*pdtok, ":") == len
+						&& !strncmp(*pdtok, *anntok, len))
+					break;
+			}
+			if (!*pdtok)
+				continue;
+			if (anns->len)
+				g_string_append_c(anns, ',');
+			g_string_append(anns, *anntok);
+		}
+		g_strfreev(anntokens);
+		g_strfreev(pdtokens);
+		opt_pd_annotations = g_string_free(anns, FALSE);
+	}
+
+	return setup_pds();
 }
 
-static int select_probes(struct sr_dev_inst *sdi)
+static int select_probes(struct sr_dev_inst *sdi, const char *probes)
 {
 	struct sr_probe *probe;
 	GSList *selected_probes, *l;
 
-	if (!opt_probes)
+	if (!probes)
 		return SR_OK;
 
-	if (!(selected_probes = parse_probestring(sdi, opt_probes)))
+	if (!(selected_probes = parse_probestring(sdi, probes)))
 		return SR_ERR;
 
 	for (l = sdi->probes; l; l = l->next) {
@@ -1084,6 +2245,63 @@ static int select_probes(struct sr_dev_inst *sdi)
 	return SR_OK;
 }
 
+/*
+ * Feed synthetic samples through the pipeline, with the probes of the
+ * selected device (the demo device, if none was given).
+ */
+static void run_benchmark(void)
+{
+	struct sr_dev_inst *sdi;
+	struct sr_output_format **outputs;
+	GSList *devices, *formats;
+	uint64_t num_samples;
+	int num_devices, n, i;
+
+	num_samples = DEFAULT_BENCHMARK_SAMPLES;
+	if (opt_samples && (sr_parse_sizestring(opt_samples,
+			&num_samples) != SR_OK || num_samples == 0)) {
+		g_critical("Invalid sample count '%s'.", opt_samples);
+		return;
+	}
+
+	if (!opt_drv)
+		opt_drv = g_strdup("demo");
+	if (!(devices = device_scan())) {
+		g_critical("No devices found.");
+		return;
+	}
+	num_devices = g_slist_length(devices);
+	n = opt_dev ? strtol(opt_dev[0], NULL, 10) : 0;
+	if (n < 0 || n >= num_devices) {
+		g_critical("%d devices found, numbered starting from 0.",
+				num_devices);
+		g_slist_free(devices);
+		return;
+	}
+	sdi = g_slist_nth_data(devices, n);
+	g_slist_free(devices);
+
+	if (select_probes(sdi, opt_probes) != SR_OK)
+		return;
+
+	/* Without -O, every logic output format is put to the test. */
+	formats = NULL;
+	if (default_output_format) {
+		outputs = sr_output_list();
+		for (i = 0; outputs[i]; i++) {
+			if (outputs[i]->df_type == SR_DF_LOGIC)
+				formats = g_slist_append(formats, outputs[i]);
+		}
+		formats = g_slist_append(formats, &output_transitions);
+	} else
+		formats = g_slist_append(formats, output_format);
+
+	benchmark_run(sdi, formats, default_output_format ? NULL
+			: output_format_param, opt_pds && !pd_farm_workers,
+			num_samples);
+	g_slist_free(formats);
+}
+
 /**
  * Return the input file format which the CLI tool should use.
  *
@@ -1143,27 +2361,100 @@ static struct sr_input_format *determine_input_file_format(
 	return inputs[i];
 }
 
-static void load_input_file_format(void)
+static int load_transitions_file(uint64_t samplerate, uint64_t chunksize)
+{
+	struct sr_dev_inst *sdi;
+	int ret;
+
+	if (!(sdi = transitions_dev_new(opt_input_file)))
+		return SR_ERR;
+
+	if ((ret = select_probes(sdi, opt_probes)) == SR_OK)
+		ret = transitions_run(opt_input_file, sdi, samplerate,
+				chunksize, NULL, 0, 0, datafeed_in);
+	dev_states_destroy();
+	input_dev_free(sdi);
+
+	return ret;
+}
+
+/* Read just the part given with --start and --end, using the index. */
+static int load_indexed_file(const struct sample_index *idx)
+{
+	struct sr_dev_inst *sdi;
+	uint64_t start, end;
+	int ret;
+
+	if (parse_window(idx->samplerate, &start, &end) != SR_OK)
+		return SR_ERR;
+	if (start && start >= idx->num_samples) {
+		g_critical("Start is past the end of the file, which has only "
+				"%" PRIu64 " samples.", idx->num_samples);
+		return SR_ERR_ARG;
+	}
+	if (!end || end > idx->num_samples)
+		end = idx->num_samples;
+	if (start >= end) {
+		g_critical("The file has only %" PRIu64 " samples.",
+				idx->num_samples);
+		return SR_ERR;
+	}
+
+	if (!(sdi = input_dev_new(idx->probe_names,
+			g_strv_length(idx->probe_names))))
+		return SR_ERR_MALLOC;
+	window_read = TRUE;
+	if ((ret = select_probes(sdi, opt_probes)) == SR_OK) {
+		if (idx->type == INDEX_SESSION)
+			ret = input_stream_run(opt_input_file, sdi, idx->samplerate,
+					DEFAULT_INPUT_CHUNKSIZE,
+					idx->data_offset + start * idx->unitsize,
+					(end - start) * idx->unitsize,
+					datafeed_in);
+		else
+			ret = transitions_run(opt_input_file, sdi, 0,
+					DEFAULT_INPUT_CHUNKSIZE, idx, start, end,
+					datafeed_in);
+	}
+	dev_states_destroy();
+	input_dev_free(sdi);
+
+	return ret;
+}
+
+static int load_input_file_format(void)
 {
 	GHashTable *fmtargs = NULL;
 	struct stat st;
 	struct sr_input *in;
 	struct sr_input_format *input_format;
-	char *fmtspec = NULL;
+	uint64_t samplerate, chunksize, start, end;
+	char *fmtspec = NULL, *val;
+	int unitsize, ret;
 
 	if (opt_input_format) {
 		fmtargs = parse_generic_arg(opt_input_format, TRUE);
 		fmtspec = g_hash_table_lookup(fmtargs, "sigrok_key");
 	}
 
-	if (!(input_format = determine_input_file_format(opt_input_file,
-						   fmtspec))) {
-		/* The exact cause was already logged. */
-		return;
+	/* Raw binary files are streamed in by the CLI itself, in chunks
+	 * of this size. */
+	chunksize = DEFAULT_INPUT_CHUNKSIZE;
+	samplerate = 0;
+	if (fmtargs && (val = g_hash_table_lookup(fmtargs, "chunksize"))) {
+		if (sr_parse_sizestring(val, &chunksize) != SR_OK
+				|| chunksize == 0) {
+			g_critical("Invalid chunk size '%s'.", val);
+			exit(1);
+		}
+		g_hash_table_remove(fmtargs, "chunksize");
+	}
+	if (fmtargs && (val = g_hash_table_lookup(fmtargs, "samplerate"))) {
+		if (sr_parse_sizestring(val, &samplerate) != SR_OK) {
+			g_critical("Invalid samplerate '%s'.", val);
+			exit(1);
+		}
 	}
-
-	if (fmtargs)
-		g_hash_table_remove(fmtargs, "sigrok_key");
 
 	if (stat(opt_input_file, &st) == -1) {
 		g_critical("Failed to load %s: %s", opt_input_file,
@@ -1171,6 +2462,26 @@ static void load_input_file_format(void)
 		exit(1);
 	}
 
+	/* Transition files aren't known to libsigrok, they're ours. */
+	if (fmtspec ? !strcasecmp(fmtspec, output_transitions.id)
+			: transitions_match(opt_input_file)) {
+		ret = load_transitions_file(samplerate, chunksize);
+		if (fmtargs)
+			g_hash_table_destroy(fmtargs);
+		return ret;
+	}
+
+	if (!(input_format = determine_input_file_format(opt_input_file,
+						   fmtspec))) {
+		/* The exact cause was already logged. */
+		if (fmtargs)
+			g_hash_table_destroy(fmtargs);
+		return SR_ERR;
+	}
+
+	if (fmtargs)
+		g_hash_table_remove(fmtargs, "sigrok_key");
+
 	/* Initialize the input module. */
 	if (!(in = g_try_malloc(sizeof(struct sr_input)))) {
 		g_critical("Failed to allocate input module.");
@@ -1185,42 +2496,86 @@ static void load_input_file_format(void)
 		}
 	}
 
-	if (select_probes(in->sdi) > 0)
-            return;
+	if ((ret = select_probes(in->sdi, opt_probes)) != SR_OK)
+		goto done;
 
 	sr_session_new();
 	sr_session_datafeed_callback_add(datafeed_in);
-	if (sr_session_dev_add(in->sdi) != SR_OK) {
+	if ((ret = sr_session_dev_add(in->sdi)) != SR_OK) {
 		g_critical("Failed to use device.");
 		sr_session_destroy();
-		return;
+		goto done;
 	}
 
-	input_format->loadfile(in, opt_input_file);
-	if (opt_output_file && default_output_format) {
-		if (sr_session_save(opt_output_file, in->sdi, singleds) != SR_OK)
-			g_critical("Failed to save session.");
-	}
+	if (!strcmp(input_format->id, "binary")) {
+		/* Samples are all the same size, so any of them can be
+		 * seeked to straight away. */
+		unitsize = (g_slist_length(in->sdi->probes) + 7) / 8;
+		if ((ret = parse_window(samplerate, &start, &end)) == SR_OK) {
+			window_read = TRUE;
+			ret = input_stream_run(opt_input_file, in->sdi,
+					samplerate, chunksize, start * unitsize,
+					end ? (end - start) * unitsize : 0,
+					datafeed_in);
+		}
+	} else if ((ret = input_format->loadfile(in, opt_input_file))
+			!= SR_OK)
+		g_critical("Failed to load %s.", opt_input_file);
 	sr_session_destroy();
+	dev_states_destroy();
 
+done:
 	if (fmtargs)
 		g_hash_table_destroy(fmtargs);
+
+	return ret;
 }
 
-static void load_input_file(void)
+/**
+ * Load the input file given with -i, and run it through the datafeed.
+ *
+ * @return SR_OK upon success, or an SR_ERR* code if the file couldn't be
+ *         read, or anything went wrong on the way.
+ */
+static int load_input_file(void)
 {
+	struct sample_index *idx;
+	int ret;
 
-	if (sr_session_load(opt_input_file) == SR_OK) {
+	datafeed_failed = FALSE;
+	if ((opt_start || opt_end) && !opt_input_format
+			&& (idx = sample_index_get(opt_input_file))) {
+		ret = load_indexed_file(idx);
+		sample_index_free(idx);
+	} else if (sr_session_load(opt_input_file) == SR_OK) {
 		/* sigrok session file */
 		sr_session_datafeed_callback_add(datafeed_in);
-		sr_session_start();
-		sr_session_run();
-		sr_session_stop();
+		session_running = TRUE;
+		if ((ret = sr_session_start()) == SR_OK)
+			ret = sr_session_run();
+		if (session_running)
+			sr_session_stop();
+		session_running = FALSE;
 	}
 	else {
 		/* fall back on input modules */
-		load_input_file_format();
+		ret = load_input_file_format();
 	}
+
+	if (ret == SR_OK && datafeed_failed)
+		ret = SR_ERR;
+
+	return ret;
+}
+
+/* Run in a worker process, for one of several input files. */
+static int batch_file(const char *filename)
+{
+	opt_input_file = (gchar *)filename;
+	if (opt_output_file)
+		opt_output_file = input_output_file(opt_output_file, filename);
+
+	return load_input_file();
 }
 
 static int set_dev_options(struct sr_dev_inst *sdi, GHashTable *args)
@@ -1295,22 +2650,22 @@ static int set_dev_options(struct sr_dev_inst *sdi, GHashTable *args)
 	return SR_OK;
 }
 
-static int set_limit_time(const struct sr_dev_inst *sdi)
+static int set_limit_time(struct dev_state *ds)
 {
+	const struct sr_dev_inst *sdi;
 	uint64_t time_msec;
 	uint64_t *samplerate;
 
+	sdi = ds->sdi;
 	time_msec = sr_parse_timestring(opt_time);
 	if (time_msec == 0) {
 		g_critical("Invalid time '%s'", opt_time);
-		sr_session_destroy();
 		return SR_ERR;
 	}
 
 	if (sr_driver_hwcap_exists(sdi->driver, SR_HWCAP_LIMIT_MSEC)) {
 		if (sr_dev_config_set(sdi, SR_HWCAP_LIMIT_MSEC, &time_msec) != SR_OK) {
 			g_critical("Failed to configure time limit.");
-			sr_session_destroy();
 			return SR_ERR;
 		}
 	}
@@ -1318,22 +2673,26 @@ static int set_limit_time(const struct sr_dev_inst *sdi)
 		/* time limit set, but device doesn't support this...
 		 * convert to samples based on the samplerate.
 		 */
-		limit_samples = 0;
-		if (sr_dev_has_hwcap(sdi, SR_HWCAP_SAMPLERATE)) {
-			sr_info_get(sdi->driver, SR_DI_CUR_SAMPLERATE,
-					(const void **)&samplerate, sdi);
-			limit_samples = (*samplerate) * time_msec / (uint64_t)1000;
+		ds->limit_samples = 0;
+		if (!sr_dev_has_hwcap(sdi, SR_HWCAP_SAMPLERATE)
+				|| sr_info_get(sdi->driver, SR_DI_CUR_SAMPLERATE,
+				(const void **)&samplerate, sdi) != SR_OK
+				|| !samplerate || *samplerate == 0) {
+			/* Nothing to go by, keep time ourselves. */
+			g_debug("cli: Limiting time to %" PRIu64 " ms in "
+					"software.", time_msec);
+			ds->limit_time = time_msec;
+			return SR_OK;
 		}
-		if (limit_samples == 0) {
+		ds->limit_samples = (*samplerate) * time_msec / (uint64_t)1000;
+		if (ds->limit_samples == 0) {
 			g_critical("Not enough time at this samplerate.");
-			sr_session_destroy();
 			return SR_ERR;
 		}
 
 		if (sr_dev_config_set(sdi, SR_HWCAP_LIMIT_SAMPLES,
-					&limit_samples) != SR_OK) {
+					&ds->limit_samples) != SR_OK) {
 			g_critical("Failed to configure time-based sample limit.");
-			sr_session_destroy();
 			return SR_ERR;
 		}
 	}
@@ -1341,53 +2700,81 @@ static int set_limit_time(const struct sr_dev_inst *sdi)
 	return SR_OK;
 }
 
-static void run_session(void)
+/*
+ * Check whether the device can handle the triggers itself. How many stages
+ * it can do is up to the driver, but at least every type must be there.
+ */
+static gboolean hw_triggers_supported(const struct sr_dev_inst *sdi,
+		const char *triggers)
 {
-	GSList *devices;
-	GHashTable *devargs;
-	struct sr_dev_inst *sdi;
-	int max_probes, i;
-	char **triggerlist;
+	const char *types, *cond;
+	char **tokens;
+	gboolean supported;
+	int i;
 
-	devices = device_scan();
-	if (!devices) {
-		g_critical("No devices found.");
-		return;
-	}
-	if (g_slist_length(devices) > 1) {
-		g_critical("sigrok-cli only supports one device for capturing.");
-		return;
+	if (sr_info_get(sdi->driver, SR_DI_TRIGGER_TYPES,
+			(const void **)&types, sdi) != SR_OK || !types)
+		return FALSE;
+
+	supported = TRUE;
+	tokens = g_strsplit(triggers, ",", 0);
+	for (i = 0; tokens[i] && supported; i++) {
+		if (!(cond = strchr(tokens[i], '=')))
+			continue;
+		while (*++cond) {
+			if (!strchr(types, *cond)) {
+				supported = FALSE;
+				break;
+			}
+		}
 	}
-	sdi = devices->data;
+	g_strfreev(tokens);
 
-	sr_session_new();
-	sr_session_datafeed_callback_add(datafeed_in);
+	return supported;
+}
+
+/* Set up one device for capturing, with its own -d options. */
+static int setup_dev(struct dev_state *ds, GHashTable *devargs)
+{
+	struct sr_dev_inst *sdi;
+	int max_probes, ret, i;
+	char **triggerlist, *probes;
 
+	sdi = (struct sr_dev_inst *)ds->sdi;
 	if (sr_session_dev_add(sdi) != SR_OK) {
 		g_critical("Failed to use device.");
-		sr_session_destroy();
-		return;
+		return SR_ERR;
 	}
 
-	if (opt_dev) {
-		if ((devargs = parse_generic_arg(opt_dev, FALSE))) {
-			if (set_dev_options(sdi, devargs) != SR_OK)
-				return;
-			g_hash_table_destroy(devargs);
+	probes = g_strdup(opt_probes);
+	if (devargs) {
+		if (g_hash_table_lookup(devargs, "probes")) {
+			g_free(probes);
+			probes = g_strdup(g_hash_table_lookup(devargs, "probes"));
+			g_hash_table_remove(devargs, "probes");
+		}
+		if (g_hash_table_size(devargs) > 0
+				&& set_dev_options(sdi, devargs) != SR_OK) {
+			g_free(probes);
+			return SR_ERR;
 		}
 	}
 
-	if (select_probes(sdi) != SR_OK) {
+	ret = select_probes(sdi, probes);
+	g_free(probes);
+	if (ret != SR_OK) {
 		g_critical("Failed to set probes.");
-		sr_session_destroy();
-		return;
+		return SR_ERR;
 	}
 
-	if (opt_triggers) {
-		if (!(triggerlist = sr_parse_triggerstring(sdi, opt_triggers))) {
-			sr_session_destroy();
-			return;
-		}
+	if (opt_triggers && (opt_sw_trigger
+			|| !hw_triggers_supported(sdi, opt_triggers))) {
+		g_debug("cli: Device %d triggers in software.", ds->index);
+		if (!(ds->swtrig = swtrig_new(sdi, opt_triggers)))
+			return SR_ERR;
+	} else if (opt_triggers) {
+		if (!(triggerlist = sr_parse_triggerstring(sdi, opt_triggers)))
+			return SR_ERR;
 		max_probes = g_slist_length(sdi->probes);
 		for (i = 0; i < max_probes; i++) {
 			if (triggerlist[i]) {
@@ -1401,57 +2788,190 @@ static void run_session(void)
 	if (opt_continuous) {
 		if (!sr_driver_hwcap_exists(sdi->driver, SR_HWCAP_CONTINUOUS)) {
 			g_critical("This device does not support continuous sampling.");
-			sr_session_destroy();
-			return;
+			return SR_ERR;
 		}
 	}
 
 	if (opt_time) {
-		if (set_limit_time(sdi) != SR_OK) {
-			sr_session_destroy();
-			return;
-		}
+		if (set_limit_time(ds) != SR_OK)
+			return SR_ERR;
 	}
 
 	if (opt_samples) {
-		if ((sr_parse_sizestring(opt_samples, &limit_samples) != SR_OK)
-				|| (sr_dev_config_set(sdi, SR_HWCAP_LIMIT_SAMPLES,
-						&limit_samples) != SR_OK)) {
+		ds->limit_samples = limit_samples;
+		if (sr_dev_config_set(sdi, SR_HWCAP_LIMIT_SAMPLES,
+				&limit_samples) != SR_OK) {
 			g_critical("Failed to configure sample limit.");
-			sr_session_destroy();
-			return;
+			return SR_ERR;
 		}
 	}
 
 	if (opt_frames) {
-		if ((sr_parse_sizestring(opt_frames, &limit_frames) != SR_OK)
-				|| (sr_dev_config_set(sdi, SR_HWCAP_LIMIT_FRAMES,
-						&limit_frames) != SR_OK)) {
+		if (sr_dev_config_set(sdi, SR_HWCAP_LIMIT_FRAMES,
+				&limit_frames) != SR_OK) {
 			g_critical("Failed to configure frame limit.");
-			sr_session_destroy();
-			return;
+			return SR_ERR;
 		}
 	}
 
-	if (sr_session_start() != SR_OK) {
-		g_critical("Failed to start session.");
-		sr_session_destroy();
+	return SR_OK;
+}
+
+static void run_session(void)
+{
+	GSList *devices;
+	GHashTable *devargs;
+	GHashTableIter iter;
+	GPtrArray *states;
+	struct sr_dev_inst *sdi;
+	struct dev_state *ds, *decode_ds;
+	gpointer key, value;
+	char *output_file, *s;
+	int num_devices, num_stdout, index, ret, i, j;
+
+	if (opt_samples && sr_parse_sizestring(opt_samples,
+			&limit_samples) != SR_OK) {
+		g_critical("Invalid sample limit '%s'.", opt_samples);
+		return;
+	}
+	if (opt_frames && sr_parse_sizestring(opt_frames,
+			&limit_frames) != SR_OK) {
+		g_critical("Invalid frame limit '%s'.", opt_frames);
+		return;
+	}
+
+	devices = device_scan();
+	if (!devices) {
+		g_critical("No devices found.");
+		return;
+	}
+	num_devices = g_slist_length(devices);
+	if (num_devices > 1 && !opt_dev) {
+		g_critical("%d devices found. Use --list-devices to show them, "
+				"and --device to select which to capture from.",
+				num_devices);
+		g_slist_free(devices);
 		return;
 	}
 
-	if (opt_continuous)
-		add_anykey();
+	sr_session_new();
+	sr_session_datafeed_callback_add(datafeed_in);
 
-	sr_session_run();
+	/* Every -d sets up one device: the one with the given number, or
+	 * the next one in the list. */
+	ret = SR_OK;
+	states = g_ptr_array_new();
+	decode_ds = NULL;
+	for (i = 0; ret == SR_OK && (i == 0 || (opt_dev && opt_dev[i])); i++) {
+		devargs = opt_dev ? parse_generic_arg(opt_dev[i], FALSE) : NULL;
+		index = i;
+		output_file = NULL;
+		if (devargs) {
+			g_hash_table_iter_init(&iter, devargs);
+			while (g_hash_table_iter_next(&iter, &key, &value)) {
+				if (value || strspn(key, "0123456789") != strlen(key))
+					continue;
+				index = strtol(key, NULL, 10);
+				g_hash_table_iter_remove(&iter);
+				break;
+			}
+			if ((s = g_hash_table_lookup(devargs, "output")))
+				output_file = g_strdup(s);
+			g_hash_table_remove(devargs, "output");
+		}
+		if (index >= num_devices) {
+			g_critical("%d devices found, numbered starting from 0.",
+					num_devices);
+			ret = SR_ERR;
+		} else {
+			sdi = g_slist_nth_data(devices, index);
+			if (dev_states && g_hash_table_lookup(dev_states, sdi)) {
+				g_critical("Device %d selected more than once.",
+						index);
+				ret = SR_ERR;
+			}
+		}
+		if (ret != SR_OK) {
+			g_free(output_file);
+			if (devargs)
+				g_hash_table_destroy(devargs);
+			break;
+		}
 
-	if (opt_continuous)
-		clear_anykey();
+		ds = dev_state_new(sdi, index);
+		g_ptr_array_add(states, ds);
+		if (output_file) {
+			g_free(ds->output_file);
+			ds->output_file = output_file;
+		}
+		/* libsigrokdecode has only one decoder session, so decoders
+		 * can only run on one device. */
+		ds->decode = FALSE;
+		if (opt_pds && devargs && g_hash_table_lookup_extended(devargs,
+				"decode", NULL, NULL)) {
+			if (decode_ds) {
+				g_critical("Protocol decoders can only run on "
+						"one device.");
+				ret = SR_ERR;
+			}
+			decode_ds = ds;
+		}
+		if (devargs)
+			g_hash_table_remove(devargs, "decode");
+		if (ret == SR_OK)
+			ret = setup_dev(ds, devargs);
+		if (devargs)
+			g_hash_table_destroy(devargs);
+	}
 
-	if (opt_output_file && default_output_format) {
-		if (sr_session_save(opt_output_file, sdi, singleds) != SR_OK)
-			g_critical("Failed to save session.");
+	if (ret == SR_OK && opt_pds) {
+		if (!decode_ds)
+			decode_ds = g_ptr_array_index(states, 0);
+		decode_ds->decode = TRUE;
 	}
+
+	/* Devices sharing -o get a file each, and only one may use stdout. */
+	num_stdout = 0;
+	for (j = 0; ret == SR_OK && j < (int)states->len; j++) {
+		ds = g_ptr_array_index(states, j);
+		if (states->len > 1 && opt_output_file
+				&& !strcmp(ds->output_file, opt_output_file)) {
+			output_file = dev_output_file(opt_output_file, ds->index);
+			g_free(ds->output_file);
+			ds->output_file = output_file;
+		}
+		if (!ds->output_file || ds->decode)
+			num_stdout++;
+	}
+	if (ret == SR_OK && num_stdout > 1) {
+		g_critical("Only one device can write to stdout, use output= "
+				"to give the others an output file.");
+		ret = SR_ERR;
+	}
+	g_ptr_array_free(states, TRUE);
+
+	if (ret == SR_OK) {
+		gettimeofday(&session_start, NULL);
+		session_running = TRUE;
+		if (sr_session_start() != SR_OK) {
+			g_critical("Failed to start session.");
+			ret = SR_ERR;
+		}
+	}
+
+	if (ret == SR_OK) {
+		if (opt_continuous)
+			add_anykey();
+
+		sr_session_run();
+
+		if (opt_continuous)
+			clear_anykey();
+	}
+	session_running = FALSE;
+
 	sr_session_destroy();
+	dev_states_destroy();
 	g_slist_free(devices);
 
 }
@@ -1477,10 +2997,15 @@ int main(int argc, char **argv)
 {
 	int ret = 1;
 	GOptionContext *context;
+	GHashTable *args;
 	GError *error;
+	char *val, **input_files;
+	gboolean failed;
 
 	g_log_set_default_handler(logger, NULL);
 
+	input_files = NULL;
+	failed = FALSE;
 	error = NULL;
 	context = g_option_context_new(NULL);
 	g_option_context_add_main_entries(context, optargs, NULL);
@@ -1498,25 +3023,187 @@ int main(int argc, char **argv)
 	if (srd_log_loglevel_set(opt_loglevel) != SRD_OK)
 		goto done;
 
+	/* Worker processes format their own annotations. */
+	if (opt_pd_format && ann_format_parse(opt_pd_format,
+			&pd_ann_format) != SR_OK)
+		goto done;
+
+	if (opt_input_files) {
+		if (!(input_files = batch_expand(opt_input_files)))
+			goto done;
+		opt_input_file = input_files[0];
+	}
+	if (opt_jobs < 1) {
+		g_critical("Invalid number of jobs %d.", opt_jobs);
+		goto done;
+	}
+	/* Each input file gets a process of its own already. */
+	if (input_files && input_files[1] && opt_pd_jobs > 1) {
+		g_critical("--pd-jobs can't be used with several input "
+				"files.");
+		goto done;
+	}
+
+	/* Worker processes are started before anything else, so they
+	 * don't inherit any threads or device handles. */
+	if (opt_pds && opt_pd_jobs > 1 && !opt_show && !opt_version
+			&& !opt_list_devs && !opt_benchmark) {
+		if ((pd_farm_workers = pd_farm_start(opt_pds, opt_pd_stack,
+				opt_pd_jobs, setup_pd_worker,
+				print_pd_annotation)) < 0)
+			goto done;
+	}
+
+	if (opt_stats)
+		stats_enable();
+
 	if (sr_init(&sr_ctx) != SR_OK)
 		goto done;
 
-	if (opt_pds) {
-		if (srd_init(NULL) != SRD_OK)
+	if (opt_pds && !pd_farm_workers) {
+		if (setup_pds() != 0)
 			goto done;
-		if (register_pds(NULL, opt_pds) != 0)
+	}
+
+	if (setup_output_format() != 0)
+		goto done;
+
+	if (opt_flush && parse_flush_policy(opt_flush, &flush_mode,
+			&flush_arg) != SR_OK)
+		goto done;
+
+	if (opt_pd_queue < 1) {
+		g_critical("Invalid protocol decoder queue depth %d.",
+				opt_pd_queue);
+		goto done;
+	}
+	pd_queue_depth = opt_pd_queue;
+	/* "0" means no timeout, which the time parser doesn't accept. */
+	if (opt_scan_timeout && strcmp(opt_scan_timeout, "0")) {
+		if (!(scan_timeout = sr_parse_timestring(opt_scan_timeout))) {
+			g_critical("Invalid scan timeout '%s'.",
+					opt_scan_timeout);
 			goto done;
-		if (srd_pd_output_callback_add(SRD_OUTPUT_ANN,
-				show_pd_annotations, NULL) != SRD_OK)
+		}
+	} else if (opt_scan_timeout) {
+		scan_timeout = 0;
+	}
+	if (opt_pre_trigger) {
+		if (sr_parse_sizestring(opt_pre_trigger, &pre_trigger) != SR_OK
+				|| pre_trigger == 0) {
+			g_critical("Invalid pre-trigger sample count '%s'.",
+					opt_pre_trigger);
 			goto done;
-		if (setup_pd_stack() != 0)
+		}
+		if (!opt_wait_trigger) {
+			g_critical("--pre-trigger needs --wait-trigger.");
 			goto done;
-		if (setup_pd_annotations() != 0)
+		}
+	}
+	if (opt_segment_size && (sr_parse_sizestring(opt_segment_size,
+			&segment_size) != SR_OK || segment_size == 0)) {
+		g_critical("Invalid segment size '%s'.", opt_segment_size);
+		goto done;
+	}
+	if (opt_segment_time && !(segment_time =
+			sr_parse_timestring(opt_segment_time))) {
+		g_critical("Invalid segment time '%s'.", opt_segment_time);
+		goto done;
+	}
+	if (opt_segment_limit && (sr_parse_sizestring(opt_segment_limit,
+			&segment_limit) != SR_OK || segment_limit == 0)) {
+		g_critical("Invalid segment limit '%s'.", opt_segment_limit);
+		goto done;
+	}
+	if ((opt_segment_keep || segment_limit) && !segment_size
+			&& !segment_time) {
+		g_critical("--segment-keep and --segment-limit need "
+				"--segment-size or --segment-time.");
+		goto done;
+	}
+	if (opt_segment_keep < 0) {
+		g_critical("Invalid number of segments to keep.");
+		goto done;
+	}
+	if ((segment_size || segment_time) && !opt_output_file) {
+		g_critical("Segments need an output file (-o).");
+		goto done;
+	}
+	if ((opt_start || opt_end) && !opt_input_file) {
+		g_critical("--start and --end need an input file (-i).");
+		goto done;
+	}
+	if (opt_decimate && (sr_parse_sizestring(opt_decimate,
+			&decimate_factor) != SR_OK || decimate_factor == 0)) {
+		g_critical("Invalid decimation factor '%s'.", opt_decimate);
+		goto done;
+	}
+	/* Decimating by 1 is no decimation at all. */
+	if (decimate_factor == 1)
+		decimate_factor = 0;
+	if (opt_decimate_mode) {
+		if (!strcmp(opt_decimate_mode, "sample"))
+			decimate_mode = DECIMATE_SAMPLE;
+		else if (!strcmp(opt_decimate_mode, "or"))
+			decimate_mode = DECIMATE_OR;
+		else if (!strcmp(opt_decimate_mode, "and"))
+			decimate_mode = DECIMATE_AND;
+		else {
+			g_critical("Invalid decimation mode '%s'.",
+					opt_decimate_mode);
 			goto done;
+		}
 	}
-
-	if (setup_output_format() != 0)
+	if (opt_analog_stats) {
+		args = parse_generic_arg(opt_analog_stats, FALSE);
+		if (!args || !(val = g_hash_table_lookup(args, "window"))
+				|| sr_parse_sizestring(val, &analog_stats_window)
+				!= SR_OK || analog_stats_window == 0) {
+			g_critical("Invalid analog statistics '%s', use "
+					"window=<samples>.", opt_analog_stats);
+			if (args)
+				g_hash_table_destroy(args);
+			goto done;
+		}
+		g_hash_table_destroy(args);
+		if (decimate_factor) {
+			g_critical("--analog-stats and --decimate can't be "
+					"used together.");
+			goto done;
+		}
+	}
+	if (opt_logic_stats_interval && !opt_logic_stats) {
+		g_critical("--logic-stats-interval needs --logic-stats.");
+		goto done;
+	}
+	if (opt_logic_stats && decimate_factor) {
+		g_critical("--logic-stats and --decimate can't be used "
+				"together.");
 		goto done;
+	}
+	if (opt_analog_threshold) {
+		if (parse_thresholds(opt_analog_threshold, NULL, NULL,
+				NULL) != SR_OK)
+			goto done;
+		if (!opt_pds) {
+			g_critical("--analog-threshold needs protocol "
+					"decoders (-a).");
+			goto done;
+		}
+	}
+	if (opt_sw_trigger && !opt_triggers) {
+		g_critical("--sw-trigger needs --triggers.");
+		goto done;
+	}
+	if (opt_pd_overflow) {
+		if (!strcmp(opt_pd_overflow, "abort"))
+			pd_queue_abort = TRUE;
+		else if (strcmp(opt_pd_overflow, "block")) {
+			g_critical("Invalid protocol decoder overflow policy "
+					"'%s'.", opt_pd_overflow);
+			goto done;
+		}
+	}
 
 	if (opt_version)
 		show_version();
@@ -1526,23 +3213,30 @@ int main(int argc, char **argv)
 		show_pd_detail();
 	else if (opt_show)
 		show_dev_detail();
+	else if (opt_benchmark)
+		run_benchmark();
+	else if (input_files && input_files[1])
+		failed = batch_run(input_files, opt_jobs, batch_file) != SR_OK;
 	else if (opt_input_file)
-		load_input_file();
+		failed = load_input_file() != SR_OK;
 	else if (opt_samples || opt_time || opt_frames || opt_continuous)
 		run_session();
 	else
 		printf("%s", g_option_context_get_help(context, TRUE, NULL));
 
-	if (opt_pds)
+	if (opt_pds && !pd_farm_workers)
 		srd_exit();
 
-	ret = 0;
+	ret = failed ? 1 : 0;
 
 done:
+	pd_farm_stop();
+	scan_wait();
 	if (sr_ctx)
 		sr_exit(sr_ctx);
 
 	g_option_context_free(context);
+	g_strfreev(input_files);
 
 	return ret;
 }
@@ -20,8 +20,78 @@
 #ifndef SIGROK_CLI_SIGROK_CLI_H
 #define SIGROK_CLI_SIGROK_CLI_H
 
+/* When to flush output, see --flush. */
+enum {
+	FLUSH_PACKET,
+	FLUSH_SIZE,
+	FLUSH_TIME,
+	FLUSH_END,
+};
+
+/* Where time is spent, see --stats. */
+enum {
+	STATS_PACKET,
+	STATS_FILTER,
+	STATS_DECIMATE,
+	STATS_OUTPUT,
+	STATS_DECODE,
+	STATS_SRD_SEND,
+	STATS_ANNOTATION,
+	STATS_FWRITE,
+	STATS_NUM_STAGES,
+};
+
+/* Protocol decoder annotation formats, see --pd-format. */
+enum {
+	ANN_FORMAT_TEXT,
+	ANN_FORMAT_JSON,
+	ANN_FORMAT_BINARY,
+};
+
+/* Why samples were thrown away. */
+enum {
+	STATS_DROP_LIMIT,
+	STATS_DROP_TRIGGER,
+	STATS_NUM_DROPS,
+};
+
+/* How logic samples are decimated, see --decimate-mode. */
+enum {
+	DECIMATE_SAMPLE,
+	DECIMATE_OR,
+	DECIMATE_AND,
+};
+
+/* What kind of file a sample index is for. */
+enum {
+	INDEX_SESSION,
+	INDEX_TRANSITIONS,
+};
+
+/* A place in the file where reading can start, see index.c. */
+struct index_point {
+	uint64_t sample;
+	uint64_t offset;
+	/* The sample there, for files which only store changes. */
+	uint8_t value[8];
+};
+
+struct sample_index {
+	int type;
+	uint64_t samplerate;
+	int unitsize;
+	uint64_t num_samples;
+	/* Where the samples start, for files which store all of them. */
+	uint64_t data_offset;
+	/* Entry points, in order. */
+	GArray *points;
+	/* NULL-terminated. */
+	char **probe_names;
+};
+
 /* sigrok-cli.c */
 int num_real_devs(void);
+void pd_annotations_flush(void);
 
 /* parsers.c */
 GSList *parse_probestring(struct sr_dev_inst *sdi, const char *probestring);
@@ -30,6 +100,174 @@ struct sr_dev *parse_devstring(const char *devstring);
 uint64_t sr_parse_timestring(const char *timestring);
 char *strcanon(const char *str);
 int canon_cmp(const char *str1, const char *str2);
+int parse_flush_policy(const char *str, int *mode, uint64_t *arg);
+int parse_sample_pos(const char *str, uint64_t samplerate, uint64_t *sample);
+int parse_thresholds(const char *str, char **probe_names, float *levels,
+		float *hysteresis);
+
+/* filter.c */
+struct probe_filter;
+struct probe_filter *probe_filter_new(int in_unitsize, int out_unitsize,
+		const int *probelist);
+int probe_filter_run(struct probe_filter *pf, const uint8_t *data_in,
+		uint64_t length_in, const uint8_t **data_out,
+		uint64_t *length_out);
+int probe_filter_in_unitsize_get(const struct probe_filter *pf);
+void probe_filter_destroy(struct probe_filter *pf);
+struct analog_filter;
+struct analog_filter *analog_filter_new(const int *probelist, int num_probes);
+int analog_filter_run(struct analog_filter *af, const float *data_in,
+		uint64_t num_samples, const float **data_out);
+void analog_filter_destroy(struct analog_filter *af);
+
+/* writer.c */
+struct writer;
+struct writer *writer_new(FILE *fp, uint64_t flush_interval);
+int writer_write(struct writer *w, const void *data, gsize len);
+void writer_seek(struct writer *w, uint64_t offset);
+void writer_flush(struct writer *w);
+int writer_sync(struct writer *w);
+void writer_destroy(struct writer *w);
+
+/* session_file.c */
+struct session_file;
+struct session_file *session_file_new(const char *filename,
+		const struct sr_dev_inst *sdi, int unitsize,
+		uint64_t samplerate, const struct timeval *starttime);
+int session_file_append(struct session_file *sf, const uint8_t *data,
+		uint64_t len);
+int session_file_close(struct session_file *sf);
+int session_file_index(const char *filename, struct sample_index *idx);
+
+/* input_stream.c */
+int input_stream_run(const char *filename, const struct sr_dev_inst *sdi,
+		uint64_t samplerate, uint64_t chunksize, uint64_t offset,
+		uint64_t length, sr_datafeed_callback_t cb);
+struct sr_dev_inst *input_dev_new(char **names, int num_probes);
+void input_dev_free(struct sr_dev_inst *sdi);
+
+/* pd_queue.c */
+int pd_queue_start(int depth, gboolean abort_on_overrun, int num_probes,
+		int unitsize, uint64_t samplerate, uint64_t flush_interval);
+int pd_queue_send(uint64_t start_sample, const uint8_t *data, uint64_t len);
+int pd_queue_end(void);
+
+/* pd_farm.c */
+typedef int (*pd_farm_setup_cb)(const char *pds, const char *stack);
+typedef void (*pd_farm_ann_cb)(const char *line, gsize len);
+int pd_farm_start(const char *pds, const char *stack, int jobs,
+		pd_farm_setup_cb setup, pd_farm_ann_cb ann_cb);
+int pd_farm_session_start(int num_probes, int unitsize, uint64_t samplerate);
+int pd_farm_send(uint64_t start_sample, const uint8_t *data, uint64_t len);
+int pd_farm_session_end(void);
+void pd_farm_stop(void);
+void pd_farm_annotation(const char *line, gsize len);
+
+/* scan.c */
+GSList *scan_all(struct sr_context *ctx, uint64_t timeout_ms,
+		gboolean use_cache);
+void scan_wait(void);
+
+/* benchmark.c */
+int benchmark_run(const struct sr_dev_inst *sdi, GSList *formats,
+		const char *param, gboolean decode, uint64_t num_samples);
+
+/* stats.c */
+void stats_enable(void);
+gint64 stats_start(void);
+void stats_stop(int stage, gint64 start);
+void stats_packet(int type, uint64_t bytes);
+void stats_drop(int reason, uint64_t samples);
+void stats_poll(void);
+void stats_print(void);
+
+/* pretrig.c */
+struct pretrig;
+struct pretrig *pretrig_new(uint64_t num_samples, int unitsize);
+uint64_t pretrig_put(struct pretrig *pt, const uint8_t *data, uint64_t len);
+uint64_t pretrig_get(struct pretrig *pt, const uint8_t **data);
+void pretrig_destroy(struct pretrig *pt);
+
+/* swtrig.c */
+struct swtrig;
+struct swtrig *swtrig_new(const struct sr_dev_inst *sdi,
+		const char *triggerstring);
+int64_t swtrig_find(struct swtrig *st, const uint8_t *data, uint64_t len);
+void swtrig_destroy(struct swtrig *st);
+
+/* segment.c */
+struct segments;
+struct segments *segments_new(uint64_t max_count, uint64_t max_bytes);
+void segments_add(struct segments *sg, const char *filename,
+		uint64_t next_size, gboolean more);
+void segments_destroy(struct segments *sg);
+
+/* transitions.c */
+extern struct sr_output_format output_transitions;
+gboolean transitions_match(const char *filename);
+struct sr_dev_inst *transitions_dev_new(const char *filename);
+int transitions_index(const char *filename, struct sample_index *idx);
+int transitions_run(const char *filename, const struct sr_dev_inst *sdi,
+		uint64_t samplerate, uint64_t chunksize,
+		const struct sample_index *idx, uint64_t start, uint64_t end,
+		sr_datafeed_callback_t cb);
+
+/* analog_bin.c */
+extern struct sr_output_format output_analog_bin;
+
+/* index.c */
+struct sample_index *sample_index_get(const char *filename);
+const struct index_point *sample_index_find(const struct sample_index *idx,
+		uint64_t sample);
+void sample_index_free(struct sample_index *idx);
+
+/* decimate.c */
+struct decimator;
+struct decimator *decimator_new(uint64_t factor, int mode, int width);
+uint64_t decimate_logic(struct decimator *dc, const uint8_t *data,
+		uint64_t len, const uint8_t **out);
+uint64_t decimate_analog(struct decimator *dc, const float *data,
+		uint64_t num_samples, const float **out);
+uint64_t decimate_logic_flush(struct decimator *dc, const uint8_t **out);
+void decimator_destroy(struct decimator *dc);
+
+/* analog_stats.c */
+struct analog_stats;
+struct analog_stats *analog_stats_new(uint64_t window, char **probe_names);
+uint64_t analog_stats_run(struct analog_stats *as, const float *data,
+		uint64_t num_samples, uint8_t **out);
+uint64_t analog_stats_flush(struct analog_stats *as, uint8_t **out);
+void analog_stats_destroy(struct analog_stats *as);
+
+/* logic_stats.c */
+struct logic_stats;
+struct logic_stats *logic_stats_new(char **probe_names, int unitsize,
+		uint64_t samplerate, uint64_t interval);
+uint64_t logic_stats_run(struct logic_stats *ls, const uint8_t *data,
+		uint64_t len, uint8_t **out);
+uint64_t logic_stats_flush(struct logic_stats *ls, uint8_t **out);
+void logic_stats_destroy(struct logic_stats *ls);
+
+/* threshold.c */
+struct threshold;
+struct threshold *threshold_new(const float *levels, const float *hysteresis,
+		int num_probes);
+int threshold_unitsize_get(const struct threshold *th);
+int threshold_run(struct threshold *th, const float *data_in,
+		uint64_t num_samples, const uint8_t **data_out,
+		uint64_t *length_out);
+void threshold_destroy(struct threshold *th);
+
+/* batch.c */
+typedef int (*batch_file_cb)(const char *filename);
+char **batch_expand(char **args);
+int batch_run(char **files, int jobs, batch_file_cb run);
+
+/* annotation.c */
+struct srd_proto_data;
+int ann_format_parse(const char *str, int *format);
+void ann_format_record(GString *s, int format,
+		const struct srd_proto_data *pdata, gboolean samples);
 
 /* anykey.c */
 void add_anykey(void);
@@ -0,0 +1,253 @@
+/*
+ * This file is part of the sigrok project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "sigrok-cli.h"
+
+/*
+ * Where does a capture spend its time? With --stats, every stage of the
+ * datafeed keeps a count of calls, the total time spent in it and a
+ * histogram of how long each call took, in power-of-two buckets of
+ * microseconds. Stages run on the session thread, the decoder thread and
+ * the writer threads, so updates are serialized with a mutex; that only
+ * costs anything when statistics are enabled at all.
+ */
+
+/* Bucket 0 is < 1 us, bucket n is [2^(n-1), 2^n) us. */
+#define STATS_HIST_BUCKETS 32
+
+struct stats_stage {
+	uint64_t calls;
+	uint64_t time;
+	uint64_t max;
+	uint64_t hist[STATS_HIST_BUCKETS];
+};
+
+/* Packet types, as counted. Anything unknown ends up in the last one. */
+static const char *packet_names[] = {
+	"header", "end", "trigger", "logic", "meta_logic", "analog",
+	"meta_analog", "frame_begin", "frame_end", "unknown",
+};
+#define STATS_NUM_PACKET_TYPES G_N_ELEMENTS(packet_names)
+
+static const char *stage_names[STATS_NUM_STAGES] = {
+	[STATS_PACKET] = "packet",
+	[STATS_FILTER] = "filter",
+	[STATS_DECIMATE] = "decimate",
+	[STATS_OUTPUT] = "output",
+	[STATS_DECODE] = "decode_queue",
+	[STATS_SRD_SEND] = "srd_send",
+	[STATS_ANNOTATION] = "annotation",
+	[STATS_FWRITE] = "fwrite",
+};
+
+static const char *drop_names[STATS_NUM_DROPS] = {
+	[STATS_DROP_LIMIT] = "limit",
+	[STATS_DROP_TRIGGER] = "trigger",
+};
+
+static gboolean enabled = FALSE;
+static GMutex stats_mutex;
+static gint64 stats_started;
+static struct stats_stage stages[STATS_NUM_STAGES];
+static uint64_t packets[STATS_NUM_PACKET_TYPES];
+static uint64_t packet_bytes[STATS_NUM_PACKET_TYPES];
+static uint64_t drops[STATS_NUM_DROPS];
+static volatile sig_atomic_t print_requested = 0;
+
+#ifdef SIGUSR1
+static void stats_signal(int sig)
+{
+	(void)sig;
+
+	print_requested = 1;
+}
+#endif
+
+static int packet_index(int type)
+{
+	if (type < SR_DF_HEADER || type > SR_DF_FRAME_END)
+		return STATS_NUM_PACKET_TYPES - 1;
+
+	return type - SR_DF_HEADER;
+}
+
+/**
+ * Start keeping statistics. Sending SIGUSR1 prints them.
+ */
+void stats_enable(void)
+{
+	enabled = TRUE;
+	stats_started = g_get_monotonic_time();
+#ifdef SIGUSR1
+	signal(SIGUSR1, stats_signal);
+#endif
+}
+
+/**
+ * Start timing a stage.
+ *
+ * @return A timestamp to pass to stats_stop(), or 0 if statistics
+ *         are not being kept.
+ */
+gint64 stats_start(void)
+{
+	if (!enabled)
+		return 0;
+
+	return g_get_monotonic_time();
+}
+
+/**
+ * Account for one call of a stage.
+ *
+ * @param stage One of the STATS_* stages.
+ * @param start What stats_start() returned when the call started.
+ */
+void stats_stop(int stage, gint64 start)
+{
+	struct stats_stage *s;
+	uint64_t t;
+	int bucket;
+
+	if (!start)
+		return;
+
+	t = g_get_monotonic_time() - start;
+	bucket = 0;
+	while (bucket < STATS_HIST_BUCKETS - 1 && (t >> bucket))
+		bucket++;
+
+	s = &stages[stage];
+	g_mutex_lock(&stats_mutex);
+	s->calls++;
+	s->time += t;
+	if (t > s->max)
+		s->max = t;
+	s->hist[bucket]++;
+	g_mutex_unlock(&stats_mutex);
+}
+
+/**
+ * Count a packet coming in from the session.
+ *
+ * @param type The packet type.
+ * @param bytes Size of the packet's payload data.
+ */
+void stats_packet(int type, uint64_t bytes)
+{
+	int i;
+
+	if (!enabled)
+		return;
+
+	i = packet_index(type);
+	g_mutex_lock(&stats_mutex);
+	packets[i]++;
+	packet_bytes[i] += bytes;
+	g_mutex_unlock(&stats_mutex);
+}
+
+/**
+ * Count samples that were received but thrown away.
+ *
+ * @param reason One of the STATS_DROP_* reasons.
+ * @param samples Number of samples dropped.
+ */
+void stats_drop(int reason, uint64_t samples)
+{
+	if (!enabled || !samples)
+		return;
+
+	g_mutex_lock(&stats_mutex);
+	drops[reason] += samples;
+	g_mutex_unlock(&stats_mutex);
+}
+
+/**
+ * Print the statistics if SIGUSR1 asked for them since the last call.
+ */
+void stats_poll(void)
+{
+	if (!print_requested)
+		return;
+
+	print_requested = 0;
+	stats_print();
+}
+
+/**
+ * Print the statistics so far, on stderr so they don't get mixed up
+ * with the output.
+ */
+void stats_print(void)
+{
+	struct stats_stage *s;
+	GString *line;
+	unsigned int i;
+	int b;
+
+	if (!enabled)
+		return;
+
+	line = g_string_sized_new(256);
+	g_mutex_lock(&stats_mutex);
+
+	g_string_append_printf(line, "stats: elapsed %.3f s\n",
+			(g_get_monotonic_time() - stats_started) / 1000000.0);
+	for (i = 0; i < STATS_NUM_PACKET_TYPES; i++) {
+		if (!packets[i])
+			continue;
+		g_string_append_printf(line, "stats: packets %s %" PRIu64
+				" bytes %" PRIu64 "\n", packet_names[i],
+				packets[i], packet_bytes[i]);
+	}
+	for (i = 0; i < STATS_NUM_DROPS; i++) {
+		g_string_append_printf(line, "stats: dropped %s %" PRIu64
+				" samples\n", drop_names[i], drops[i]);
+	}
+	for (i = 0; i < STATS_NUM_STAGES; i++) {
+		s = &stages[i];
+		if (!s->calls)
+			continue;
+		g_string_append_printf(line, "stats: stage %s calls %" PRIu64
+				" total %.3f ms avg %.1f us max %" PRIu64 " us\n",
+				stage_names[i], s->calls, s->time / 1000.0,
+				(double)s->time / s->calls, s->max);
+		g_string_append_printf(line, "stats: hist %s", stage_names[i]);
+		for (b = 0; b < STATS_HIST_BUCKETS; b++) {
+			if (s->hist[b])
+				g_string_append_printf(line, " <%" PRIu64 "us:%"
+						PRIu64, (uint64_t)1 << b,
+						s->hist[b]);
+		}
+		g_string_append_c(line, '\n');
+	}
+
+	g_mutex_unlock(&stats_mutex);
+	fwrite(line->str, 1, line->len, stderr);
+	fflush(stderr);
+	g_string_free(line, TRUE);
+}
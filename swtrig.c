@@ -0,0 +1,368 @@
+/*
+ * This file is part of the sigrok project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "sigrok-cli.h"
+
+/*
+ * A trigger evaluated on the samples as they come in, for devices which
+ * can't trigger themselves, or not on the conditions asked for. It takes
+ * the same trigger strings as the hardware triggers: character n of each
+ * probe's string is its condition in stage n, and each stage has to match
+ * on the sample right after the one the previous stage matched on. Every
+ * sample can start a new match, so partial matches are kept as a bitmask
+ * of the stages reached, which needs no going back over older samples.
+ *
+ * Conditions are kept as masks over the filtered samples, so a whole sample
+ * is checked in a handful of operations. Most of the time is spent looking
+ * for the first stage, which is done on several samples at once, packed
+ * into a 64-bit word, for the common sample sizes of one and two bytes.
+ */
+
+#define SWTRIG_MAX_STAGES 32
+
+struct swtrig_stage {
+	/* Probes with a 0 or 1 condition, and the value they need. */
+	uint64_t level;
+	uint64_t value;
+	/* Probes with an r, f or c condition. */
+	uint64_t rise;
+	uint64_t fall;
+	uint64_t change;
+};
+
+struct swtrig {
+	int unitsize;
+	int num_stages;
+	struct swtrig_stage stages[SWTRIG_MAX_STAGES];
+	/* Bit n set if the last sample completed stage n of some match. */
+	uint64_t active;
+	/* The last sample of the previous packet, for edges. */
+	uint64_t prev;
+	gboolean have_prev;
+};
+
+static inline uint64_t sample_get(const uint8_t *data, uint64_t i, int unitsize)
+{
+	const uint8_t *p;
+	uint64_t s;
+	int b;
+
+	p = data + i * unitsize;
+	s = 0;
+	for (b = unitsize - 1; b >= 0; b--)
+		s = (s << 8) | p[b];
+
+	return s;
+}
+
+static inline gboolean stage_match(const struct swtrig_stage *st,
+		uint64_t prev, uint64_t cur)
+{
+	return ((cur ^ st->value) & st->level) == 0
+			&& (st->rise & (prev | ~cur)) == 0
+			&& (st->fall & (~prev | cur)) == 0
+			&& (st->change & ~(prev ^ cur)) == 0;
+}
+
+/* Spread a value over every lane of a 64-bit word. */
+static inline uint64_t broadcast(uint64_t v, uint64_t ones, uint64_t lane_mask)
+{
+	return (v & lane_mask) * ones;
+}
+
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+/*
+ * Check whole words of samples at once for the first stage: every lane
+ * ends up 0 where its sample matches, and the usual carry trick turns that
+ * into the lane's top bit. Returns where the match is, or where the samples
+ * that don't fill a word start, with prev set to the sample before that.
+ */
+static uint64_t scan_words(const struct swtrig *st, const uint8_t *data,
+		uint64_t i, uint64_t n, uint64_t *prev)
+{
+	const struct swtrig_stage *s;
+	uint64_t ones, lane_mask, high, low, level, value, rise, fall, change;
+	uint64_t cur, prevs, miss, zero;
+	int bits, lanes, k;
+
+	s = &st->stages[0];
+	bits = st->unitsize * 8;
+	lanes = 64 / bits;
+	ones = bits == 8 ? 0x0101010101010101ULL : 0x0001000100010001ULL;
+	lane_mask = bits == 8 ? 0xff : 0xffff;
+	high = ones << (bits - 1);
+	low = ~high;
+	level = broadcast(s->level, ones, lane_mask);
+	value = broadcast(s->value, ones, lane_mask);
+	rise = broadcast(s->rise, ones, lane_mask);
+	fall = broadcast(s->fall, ones, lane_mask);
+	change = broadcast(s->change, ones, lane_mask);
+
+	for (; i + lanes <= n; i += lanes) {
+		memcpy(&cur, data + i * st->unitsize, 8);
+		prevs = (cur << bits) | *prev;
+		miss = ((cur ^ value) & level)
+				| (rise & (prevs | ~cur))
+				| (fall & (~prevs | cur))
+				| (change & ~(prevs ^ cur));
+		zero = ~(((miss & low) + low) | miss | low);
+		if (zero) {
+			for (k = 0; !(zero & (high << (k * bits))); k++)
+				;
+			if (k)
+				*prev = (cur >> ((k - 1) * bits)) & lane_mask;
+			return i + k;
+		}
+		*prev = cur >> (64 - bits);
+	}
+
+	return i;
+}
+#endif
+
+/* Find the first sample from i on which matches the first stage, or n. */
+static uint64_t scan_first_stage(const struct swtrig *st, const uint8_t *data,
+		uint64_t i, uint64_t n, uint64_t prev)
+{
+	uint64_t cur;
+
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+	if (st->unitsize <= 2)
+		i = scan_words(st, data, i, n, &prev);
+#endif
+
+	for (; i < n; i++) {
+		cur = sample_get(data, i, st->unitsize);
+		if (stage_match(&st->stages[0], prev, cur))
+			return i;
+		prev = cur;
+	}
+
+	return n;
+}
+
+static struct sr_probe *probe_find(const struct sr_dev_inst *sdi,
+		const char *name)
+{
+	struct sr_probe *probe;
+	GSList *l;
+	char *end;
+	long num;
+
+	for (l = sdi->probes; l; l = l->next) {
+		probe = l->data;
+		if (probe->name && !strcmp(probe->name, name))
+			return probe;
+	}
+
+	num = strtol(name, &end, 10);
+	if (end == name || *end)
+		return NULL;
+	for (l = sdi->probes; l; l = l->next) {
+		probe = l->data;
+		if (probe->index == num)
+			return probe;
+	}
+
+	return NULL;
+}
+
+/*
+ * Where a probe's samples end up after the probe filter, or with probe
+ * NULL, how many bits there are.
+ */
+static int probe_bit(const struct sr_dev_inst *sdi, const struct sr_probe *probe)
+{
+	struct sr_probe *p;
+	GSList *l;
+	int bit;
+
+	bit = 0;
+	for (l = sdi->probes; l; l = l->next) {
+		p = l->data;
+		if (p == probe)
+			return bit;
+		if (p->type == SR_PROBE_LOGIC && p->enabled)
+			bit++;
+	}
+
+	return probe ? -1 : bit;
+}
+
+/**
+ * Set up a software trigger.
+ *
+ * @param sdi The device, with its probes already enabled or disabled.
+ * @param triggerstring The triggers, in the same format as for the
+ *                      hardware triggers: "<probe>=<conditions>,...".
+ *
+ * @return The trigger, or NULL upon errors.
+ */
+struct swtrig *swtrig_new(const struct sr_dev_inst *sdi,
+		const char *triggerstring)
+{
+	struct swtrig *st;
+	struct swtrig_stage *s;
+	struct sr_probe *probe;
+	uint64_t bit;
+	char **tokens, *cond;
+	int b, i, j;
+
+	if (!(st = g_try_malloc0(sizeof(struct swtrig)))) {
+		g_critical("Software trigger malloc failed.");
+		return NULL;
+	}
+	st->unitsize = (probe_bit(sdi, NULL) + 7) / 8;
+
+	tokens = g_strsplit(triggerstring, ",", 0);
+	for (i = 0; tokens[i]; i++) {
+		if (!(cond = strchr(tokens[i], '='))) {
+			g_critical("Invalid trigger '%s'.", tokens[i]);
+			goto err;
+		}
+		*cond++ = '\0';
+		if (!(probe = probe_find(sdi, tokens[i]))) {
+			g_critical("Trigger on unknown probe '%s'.", tokens[i]);
+			goto err;
+		}
+		if (probe->type != SR_PROBE_LOGIC || !probe->enabled) {
+			g_critical("Trigger on probe '%s', which is not an "
+					"enabled logic probe.", tokens[i]);
+			goto err;
+		}
+		if ((b = probe_bit(sdi, probe)) >= 64) {
+			g_critical("Trigger on probe '%s' is out of range.",
+					tokens[i]);
+			goto err;
+		}
+		bit = (uint64_t)1 << b;
+		if (strlen(cond) > SWTRIG_MAX_STAGES) {
+			g_critical("Triggers can have at most %d stages.",
+					SWTRIG_MAX_STAGES);
+			goto err;
+		}
+		for (j = 0; cond[j]; j++) {
+			s = &st->stages[j];
+			switch (cond[j]) {
+			case '0':
+				s->level |= bit;
+				break;
+			case '1':
+				s->level |= bit;
+				s->value |= bit;
+				break;
+			case 'r':
+				s->rise |= bit;
+				break;
+			case 'f':
+				s->fall |= bit;
+				break;
+			case 'c':
+				s->change |= bit;
+				break;
+			default:
+				g_critical("Invalid trigger type '%c'.", cond[j]);
+				goto err;
+			}
+		}
+		st->num_stages = MAX(st->num_stages, j);
+	}
+	g_strfreev(tokens);
+
+	if (st->num_stages == 0) {
+		g_critical("No trigger conditions given.");
+		g_free(st);
+		return NULL;
+	}
+	g_debug("cli: Software trigger with %d stage(s).", st->num_stages);
+
+	return st;
+
+err:
+	g_strfreev(tokens);
+	g_free(st);
+	return NULL;
+}
+
+/**
+ * Look for the trigger in the next packet of samples. Once it has been
+ * found, there's no need to call this again.
+ *
+ * @param st The trigger.
+ * @param data The samples, as they come out of the probe filter.
+ * @param len Length of the samples, in bytes.
+ *
+ * @return The number of the sample in this packet on which the trigger
+ *         fired, or -1 if it didn't.
+ */
+int64_t swtrig_find(struct swtrig *st, const uint8_t *data, uint64_t len)
+{
+	uint64_t n, i, prev, cur, active, all, last;
+	int s;
+
+	n = len / st->unitsize;
+	if (n == 0)
+		return -1;
+
+	/* The very first sample has no edges. */
+	if (!st->have_prev) {
+		st->prev = sample_get(data, 0, st->unitsize);
+		st->have_prev = TRUE;
+	}
+
+	all = ((uint64_t)1 << (st->num_stages - 1) << 1) - 1;
+	last = (uint64_t)1 << (st->num_stages - 1);
+	prev = st->prev;
+	for (i = 0; i < n; i++) {
+		/* Nothing going on: skip ahead to where something starts. */
+		if (!st->active) {
+			i = scan_first_stage(st, data, i, n, prev);
+			if (i == n)
+				break;
+			prev = i ? sample_get(data, i - 1, st->unitsize) : st->prev;
+		}
+		cur = sample_get(data, i, st->unitsize);
+		active = ((st->active << 1) | 1) & all;
+		for (s = 0; s < st->num_stages; s++) {
+			if ((active & ((uint64_t)1 << s))
+					&& !stage_match(&st->stages[s], prev, cur))
+				active &= ~((uint64_t)1 << s);
+		}
+		st->active = active;
+		if (active & last) {
+			st->prev = cur;
+			return i;
+		}
+		prev = cur;
+	}
+	st->prev = sample_get(data, n - 1, st->unitsize);
+
+	return -1;
+}
+
+void swtrig_destroy(struct swtrig *st)
+{
+	g_free(st);
+}
@@ -0,0 +1,219 @@
+/*
+ * This file is part of the sigrok project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "sigrok-cli.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_AVX_KERNEL 1
+#endif
+
+/*
+ * Protocol decoders only take logic samples. With --analog-threshold,
+ * every analog probe becomes a logic probe: high once its value goes above
+ * the level plus half the hysteresis, low once it goes below the level
+ * minus half of it, and otherwise unchanged. Probes start out low.
+ *
+ * Whether each probe is above or below its thresholds comes down to a
+ * bitmask per sample, with a bit for every probe; the new state of all the
+ * probes is then high | (state & ~low). Values which aren't numbers fail
+ * both compares, so they leave the probe as it was.
+ */
+
+typedef void (*threshold_func)(struct threshold *th, const float *in,
+		uint8_t *out, uint64_t num_samples);
+
+struct threshold {
+	int num_probes;
+	int unitsize;
+	float high[SR_MAX_NUM_PROBES];
+	float low[SR_MAX_NUM_PROBES];
+	uint64_t state;
+	threshold_func run;
+	uint8_t *buf;
+	uint64_t bufsize;
+};
+
+static inline void store_sample(uint8_t *out, uint64_t state, int unitsize)
+{
+	int b;
+
+	for (b = 0; b < unitsize; b++)
+		out[b] = state >> (b * 8);
+}
+
+static void threshold_generic(struct threshold *th, const float *in,
+		uint8_t *out, uint64_t num_samples)
+{
+	uint64_t i, high, low, state;
+	int n, p;
+
+	n = th->num_probes;
+	state = th->state;
+	for (i = 0; i < num_samples; i++) {
+		high = low = 0;
+		for (p = 0; p < n; p++) {
+			high |= (uint64_t)(in[p] > th->high[p]) << p;
+			low |= (uint64_t)(in[p] < th->low[p]) << p;
+		}
+		state = high | (state & ~low);
+		store_sample(out, state, th->unitsize);
+		in += n;
+		out += th->unitsize;
+	}
+	th->state = state;
+}
+
+#ifdef HAVE_AVX_KERNEL
+/*
+ * For 1, 2, 4 or 8 probes, eight values are compared at once, and the
+ * masks of the compares hold one or more whole samples.
+ */
+__attribute__((target("avx")))
+static void threshold_avx(struct threshold *th, const float *in,
+		uint8_t *out, uint64_t num_samples)
+{
+	__m256 vhigh, vlow, v;
+	float high[8], low[8];
+	uint64_t i, state;
+	unsigned int mhigh, mlow, mask;
+	int n, per, k;
+
+	n = th->num_probes;
+	per = 8 / n;
+	mask = (1 << n) - 1;
+	for (k = 0; k < 8; k++) {
+		high[k] = th->high[k % n];
+		low[k] = th->low[k % n];
+	}
+	vhigh = _mm256_loadu_ps(high);
+	vlow = _mm256_loadu_ps(low);
+
+	state = th->state;
+	for (i = 0; i + per <= num_samples; i += per) {
+		v = _mm256_loadu_ps(in + i * n);
+		mhigh = _mm256_movemask_ps(_mm256_cmp_ps(v, vhigh, _CMP_GT_OQ));
+		mlow = _mm256_movemask_ps(_mm256_cmp_ps(v, vlow, _CMP_LT_OQ));
+		for (k = 0; k < per; k++) {
+			state = ((mhigh >> (k * n)) & mask)
+					| (state & ~(uint64_t)((mlow >> (k * n))
+					& mask));
+			out[i + k] = state;
+		}
+	}
+	th->state = state;
+	threshold_generic(th, in + i * n, out + i, num_samples - i);
+}
+#endif
+
+/**
+ * Set up turning analog probes into logic probes.
+ *
+ * @param levels The level of each probe.
+ * @param hysteresis How far apart the thresholds for going high and going
+ *                   low are, for each probe.
+ * @param num_probes Number of probes.
+ *
+ * @return The threshold stage, or NULL upon errors.
+ */
+struct threshold *threshold_new(const float *levels, const float *hysteresis,
+		int num_probes)
+{
+	struct threshold *th;
+	int p;
+
+	if (num_probes < 1 || num_probes > 64) {
+		g_critical("Can't threshold %d analog probes.", num_probes);
+		return NULL;
+	}
+	if (!(th = g_try_malloc0(sizeof(struct threshold)))) {
+		g_critical("Threshold malloc failed.");
+		return NULL;
+	}
+	th->num_probes = num_probes;
+	th->unitsize = (num_probes + 7) / 8;
+	for (p = 0; p < num_probes; p++) {
+		th->high[p] = levels[p] + hysteresis[p] / 2;
+		th->low[p] = levels[p] - hysteresis[p] / 2;
+	}
+
+	th->run = threshold_generic;
+#ifdef HAVE_AVX_KERNEL
+	if (8 % num_probes == 0 && __builtin_cpu_supports("avx"))
+		th->run = threshold_avx;
+#endif
+	g_debug("cli: Thresholding %d analog probes into %d-byte samples.",
+			num_probes, th->unitsize);
+
+	return th;
+}
+
+int threshold_unitsize_get(const struct threshold *th)
+{
+	return th->unitsize;
+}
+
+/**
+ * Turn analog samples into logic samples.
+ *
+ * @param th The threshold stage.
+ * @param data_in The samples, one float per probe each.
+ * @param num_samples Number of samples.
+ * @param data_out Set to the logic samples, which stay valid until the
+ *                 next call.
+ * @param length_out Set to the length of the logic samples, in bytes.
+ *
+ * @return SR_OK upon success, SR_ERR_MALLOC upon memory shortage.
+ */
+int threshold_run(struct threshold *th, const float *data_in,
+		uint64_t num_samples, const uint8_t **data_out,
+		uint64_t *length_out)
+{
+	uint64_t len;
+	uint8_t *buf;
+
+	len = num_samples * th->unitsize;
+	if (len > th->bufsize) {
+		if (!(buf = g_try_realloc(th->buf, len))) {
+			g_critical("Threshold buffer malloc failed.");
+			return SR_ERR_MALLOC;
+		}
+		th->buf = buf;
+		th->bufsize = len;
+	}
+	th->run(th, data_in, th->buf, num_samples);
+	*data_out = th->buf;
+	*length_out = len;
+
+	return SR_OK;
+}
+
+void threshold_destroy(struct threshold *th)
+{
+	if (!th)
+		return;
+
+	g_free(th->buf);
+	g_free(th);
+}
@@ -0,0 +1,613 @@
+/*
+ * This file is part of the sigrok project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libsigrok/libsigrok.h>
+#include "sigrok-cli.h"
+
+/*
+ * Most logic captures are idle most of the time, so rather than every
+ * sample, this format only stores the samples where something changes:
+ *
+ *   "SRTRANS1"        magic
+ *   varint            samplerate in Hz, 0 if not known
+ *   u8                number of probes, each followed by its name as
+ *                     a u8 length and the name itself
+ *   unitsize bytes    the first sample
+ *
+ * followed by one record per change:
+ *
+ *   varint n > 0      the samples change n samples after the previous
+ *                     change (or the first sample)
+ *   unitsize bytes    the new sample
+ *
+ * and finally:
+ *
+ *   varint 0          end of the samples
+ *   varint            total number of samples
+ *
+ * A varint is an unsigned integer, 7 bits per byte, least significant
+ * first, with the top bit set on all but the last byte. Samples are as
+ * they come in, little-endian, one bit per probe.
+ */
+
+#define TRANSITIONS_MAGIC "SRTRANS1"
+#define TRANSITIONS_MAGIC_LEN 8
+#define TRANSITIONS_MAX_UNITSIZE 8
+/* How many samples apart the index has its entry points, at least. */
+#define TRANSITIONS_INDEX_STEP (1024 * 1024)
+
+struct encoder {
+	int unitsize;
+	int num_probes;
+	uint64_t samplerate;
+	gboolean started;
+	/* The last sample seen, and the sample number it changed at. */
+	uint8_t last[TRANSITIONS_MAX_UNITSIZE];
+	uint64_t last_change;
+	uint64_t num_samples;
+};
+
+static void put_varint(GString *s, uint64_t v)
+{
+	while (v >= 0x80) {
+		g_string_append_c(s, (v & 0x7f) | 0x80);
+		v >>= 7;
+	}
+	g_string_append_c(s, v);
+}
+
+static int init(struct sr_output *o)
+{
+	struct encoder *enc;
+	struct sr_probe *probe;
+	GSList *l;
+	uint64_t *samplerate;
+
+	if (!(enc = g_try_malloc0(sizeof(struct encoder)))) {
+		g_critical("Transition encoder malloc failed.");
+		return SR_ERR_MALLOC;
+	}
+
+	for (l = o->sdi->probes; l; l = l->next) {
+		probe = l->data;
+		if (probe->type == SR_PROBE_LOGIC && probe->enabled)
+			enc->num_probes++;
+	}
+	enc->unitsize = (enc->num_probes + 7) / 8;
+	if (enc->unitsize == 0 || enc->unitsize > TRANSITIONS_MAX_UNITSIZE
+			|| enc->num_probes > G_MAXUINT8) {
+		g_critical("Transition output needs 1 to %d probes.",
+				TRANSITIONS_MAX_UNITSIZE * 8);
+		g_free(enc);
+		return SR_ERR_ARG;
+	}
+
+	if (o->sdi->driver && sr_dev_has_hwcap(o->sdi, SR_HWCAP_SAMPLERATE)
+			&& sr_info_get(o->sdi->driver, SR_DI_CUR_SAMPLERATE,
+			(const void **)&samplerate, o->sdi) == SR_OK)
+		enc->samplerate = *samplerate;
+	o->internal = enc;
+
+	return SR_OK;
+}
+
+static void put_header(struct sr_output *o, GString *s, const uint8_t *first)
+{
+	struct encoder *enc;
+	struct sr_probe *probe;
+	GSList *l;
+	gsize len;
+
+	enc = o->internal;
+	g_string_append_len(s, TRANSITIONS_MAGIC, TRANSITIONS_MAGIC_LEN);
+	put_varint(s, enc->samplerate);
+	g_string_append_c(s, enc->num_probes);
+	for (l = o->sdi->probes; l; l = l->next) {
+		probe = l->data;
+		if (probe->type != SR_PROBE_LOGIC || !probe->enabled)
+			continue;
+		len = MIN(strlen(probe->name), G_MAXUINT8);
+		g_string_append_c(s, len);
+		g_string_append_len(s, probe->name, len);
+	}
+	g_string_append_len(s, (const char *)first, enc->unitsize);
+	memcpy(enc->last, first, enc->unitsize);
+	enc->started = TRUE;
+}
+
+/*
+ * Find the next sample from i on which differs from the last one, or n.
+ * Sample sizes which fit a 64-bit word evenly are compared a word at a
+ * time first, which gets through long idle stretches quickly.
+ */
+static uint64_t next_change(const struct encoder *enc, const uint8_t *data,
+		uint64_t i, uint64_t n)
+{
+	uint8_t buf[8];
+	uint64_t pattern, word;
+	int per_word, b;
+
+	if (8 % enc->unitsize == 0) {
+		for (b = 0; b < 8; b += enc->unitsize)
+			memcpy(buf + b, enc->last, enc->unitsize);
+		memcpy(&pattern, buf, 8);
+		per_word = 8 / enc->unitsize;
+		for (; i + per_word <= n; i += per_word) {
+			memcpy(&word, data + i * enc->unitsize, 8);
+			if (word != pattern)
+				break;
+		}
+	}
+
+	for (; i < n; i++) {
+		if (memcmp(data + i * enc->unitsize, enc->last, enc->unitsize))
+			break;
+	}
+
+	return i;
+}
+
+static int data(struct sr_output *o, const uint8_t *data_in,
+		uint64_t length_in, uint8_t **data_out, uint64_t *length_out)
+{
+	struct encoder *enc;
+	GString *s;
+	uint64_t n, i;
+	const uint8_t *p;
+
+	enc = o->internal;
+	*data_out = NULL;
+	*length_out = 0;
+	if (!(n = length_in / enc->unitsize))
+		return SR_OK;
+
+	s = g_string_sized_new(64);
+	if (!enc->started)
+		put_header(o, s, data_in);
+
+	for (i = 0; (i = next_change(enc, data_in, i, n)) < n; i++) {
+		p = data_in + i * enc->unitsize;
+		put_varint(s, enc->num_samples + i - enc->last_change);
+		g_string_append_len(s, (const char *)p, enc->unitsize);
+		memcpy(enc->last, p, enc->unitsize);
+		enc->last_change = enc->num_samples + i;
+	}
+	enc->num_samples += n;
+
+	*length_out = s->len;
+	*data_out = (uint8_t *)g_string_free(s, s->len == 0);
+
+	return SR_OK;
+}
+
+static int event(struct sr_output *o, int event_type, uint8_t **data_out,
+		uint64_t *length_out)
+{
+	struct encoder *enc;
+	uint8_t zero[TRANSITIONS_MAX_UNITSIZE];
+	GString *s;
+
+	enc = o->internal;
+	*data_out = NULL;
+	*length_out = 0;
+	if (event_type != SR_DF_END)
+		return SR_OK;
+
+	s = g_string_sized_new(32);
+	if (!enc->started) {
+		memset(zero, 0, sizeof(zero));
+		put_header(o, s, zero);
+	}
+	put_varint(s, 0);
+	put_varint(s, enc->num_samples);
+	*length_out = s->len;
+	*data_out = (uint8_t *)g_string_free(s, FALSE);
+
+	return SR_OK;
+}
+
+static int cleanup(struct sr_output *o)
+{
+	g_free(o->internal);
+	o->internal = NULL;
+
+	return SR_OK;
+}
+
+struct sr_output_format output_transitions = {
+	.id = "transitions",
+	.description = "Logic transitions, with varint sample counts",
+	.df_type = SR_DF_LOGIC,
+	.init = init,
+	.data = data,
+	.event = event,
+	.cleanup = cleanup,
+};
+
+/* Reading it back in. */
+
+struct decoder {
+	FILE *fp;
+	const char *filename;
+	uint64_t samplerate;
+	int num_probes;
+	int unitsize;
+	char *names[256];
+	uint8_t first[TRANSITIONS_MAX_UNITSIZE];
+};
+
+static int get_u8(struct decoder *dec, uint8_t *v)
+{
+	int c;
+
+	if ((c = getc(dec->fp)) == EOF) {
+		g_critical("%s: unexpected end of file.", dec->filename);
+		return SR_ERR;
+	}
+	*v = c;
+
+	return SR_OK;
+}
+
+static int get_bytes(struct decoder *dec, void *buf, size_t len)
+{
+	if (fread(buf, 1, len, dec->fp) != len) {
+		g_critical("%s: unexpected end of file.", dec->filename);
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+
+static int get_varint(struct decoder *dec, uint64_t *v)
+{
+	uint8_t b;
+	int shift;
+
+	*v = 0;
+	for (shift = 0; shift < 64; shift += 7) {
+		if (get_u8(dec, &b) != SR_OK)
+			return SR_ERR;
+		*v |= (uint64_t)(b & 0x7f) << shift;
+		if (!(b & 0x80))
+			return SR_OK;
+	}
+	g_critical("%s: invalid number.", dec->filename);
+
+	return SR_ERR;
+}
+
+static void decoder_close(struct decoder *dec)
+{
+	int i;
+
+	if (dec->fp)
+		fclose(dec->fp);
+	for (i = 0; i < dec->num_probes; i++)
+		g_free(dec->names[i]);
+}
+
+static int decoder_open(struct decoder *dec, const char *filename)
+{
+	char magic[TRANSITIONS_MAGIC_LEN];
+	uint8_t len, n;
+	int i;
+
+	memset(dec, 0, sizeof(struct decoder));
+	dec->filename = filename;
+	if (!(dec->fp = g_fopen(filename, "rb"))) {
+		g_critical("Failed to open %s: %s.", filename, strerror(errno));
+		return SR_ERR;
+	}
+	if (fread(magic, 1, TRANSITIONS_MAGIC_LEN, dec->fp)
+			!= TRANSITIONS_MAGIC_LEN || memcmp(magic,
+			TRANSITIONS_MAGIC, TRANSITIONS_MAGIC_LEN)) {
+		g_critical("%s is not a transitions file.", filename);
+		return SR_ERR;
+	}
+	if (get_varint(dec, &dec->samplerate) != SR_OK
+			|| get_u8(dec, &n) != SR_OK)
+		return SR_ERR;
+	for (i = 0; i < n; i++) {
+		if (get_u8(dec, &len) != SR_OK)
+			return SR_ERR;
+		if (!(dec->names[i] = g_try_malloc0(len + 1))) {
+			g_critical("Probe name malloc failed.");
+			return SR_ERR_MALLOC;
+		}
+		dec->num_probes++;
+		if (get_bytes(dec, dec->names[i], len) != SR_OK)
+			return SR_ERR;
+	}
+	dec->unitsize = (dec->num_probes + 7) / 8;
+	if (dec->unitsize == 0 || dec->unitsize > TRANSITIONS_MAX_UNITSIZE) {
+		g_critical("%s: invalid number of probes.", filename);
+		return SR_ERR;
+	}
+
+	return get_bytes(dec, dec->first, dec->unitsize);
+}
+
+/**
+ * Check whether a file is in the transitions format.
+ *
+ * @param filename The file.
+ *
+ * @return TRUE if it is.
+ */
+gboolean transitions_match(const char *filename)
+{
+	FILE *fp;
+	char magic[TRANSITIONS_MAGIC_LEN];
+	gboolean match;
+
+	if (!(fp = g_fopen(filename, "rb")))
+		return FALSE;
+	match = fread(magic, 1, TRANSITIONS_MAGIC_LEN, fp)
+			== TRANSITIONS_MAGIC_LEN && !memcmp(magic,
+			TRANSITIONS_MAGIC, TRANSITIONS_MAGIC_LEN);
+	fclose(fp);
+
+	return match;
+}
+
+/**
+ * Create a device instance with the probes stored in a transitions file.
+ *
+ * @param filename The file.
+ *
+ * @return The device instance, to be freed with input_dev_free(), or NULL
+ *         upon errors.
+ */
+struct sr_dev_inst *transitions_dev_new(const char *filename)
+{
+	struct decoder dec;
+	struct sr_dev_inst *sdi;
+
+	sdi = NULL;
+	if (decoder_open(&dec, filename) == SR_OK)
+		sdi = input_dev_new(dec.names, dec.num_probes);
+	decoder_close(&dec);
+
+	return sdi;
+}
+
+/**
+ * Index a transitions file: every so many samples, note where in the file
+ * decoding can pick up, and with which sample.
+ *
+ * @param filename The file.
+ * @param idx The index to fill in.
+ *
+ * @return SR_OK upon success, or an SR_ERR* code upon errors.
+ */
+int transitions_index(const char *filename, struct sample_index *idx)
+{
+	struct decoder dec;
+	struct index_point pt;
+	uint64_t n, pos, next;
+	int ret, i;
+
+	if (decoder_open(&dec, filename) != SR_OK) {
+		decoder_close(&dec);
+		return SR_ERR;
+	}
+
+	idx->type = INDEX_TRANSITIONS;
+	idx->samplerate = dec.samplerate;
+	idx->unitsize = dec.unitsize;
+	if (!(idx->probe_names = g_try_malloc0((dec.num_probes + 1)
+			* sizeof(char *)))) {
+		g_critical("Index malloc failed.");
+		decoder_close(&dec);
+		return SR_ERR_MALLOC;
+	}
+	for (i = 0; i < dec.num_probes; i++)
+		idx->probe_names[i] = g_strdup(dec.names[i]);
+
+	memset(&pt, 0, sizeof(pt));
+	memcpy(pt.value, dec.first, dec.unitsize);
+	pos = next = 0;
+	while (TRUE) {
+		if (pos >= next) {
+			pt.sample = pos;
+			pt.offset = ftello(dec.fp);
+			g_array_append_val(idx->points, pt);
+			next = pos + TRANSITIONS_INDEX_STEP;
+		}
+		if ((ret = get_varint(&dec, &n)) != SR_OK || !n)
+			break;
+		pos += n;
+		if ((ret = get_bytes(&dec, pt.value, dec.unitsize)) != SR_OK)
+			break;
+	}
+	if (ret == SR_OK)
+		ret = get_varint(&dec, &idx->num_samples);
+	decoder_close(&dec);
+
+	return ret;
+}
+
+static void send_logic(const struct sr_dev_inst *sdi, sr_datafeed_callback_t cb,
+		const uint8_t *data, uint64_t len, int unitsize)
+{
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_logic logic;
+
+	logic.length = len;
+	logic.unitsize = unitsize;
+	logic.data = (void *)data;
+	packet.type = SR_DF_LOGIC;
+	packet.payload = &logic;
+	cb(sdi, &packet);
+}
+
+/* Expand a run of identical samples, a packet's worth at a time. */
+static void send_run(struct decoder *dec, const struct sr_dev_inst *sdi,
+		sr_datafeed_callback_t cb, uint8_t *buf, uint64_t *len,
+		uint64_t chunksize, const uint8_t *sample, uint64_t count)
+{
+	uint64_t n, i;
+
+	while (count) {
+		n = MIN(count, (chunksize - *len) / dec->unitsize);
+		if (dec->unitsize == 1) {
+			memset(buf + *len, sample[0], n);
+		} else {
+			for (i = 0; i < n; i++)
+				memcpy(buf + *len + i * dec->unitsize, sample,
+						dec->unitsize);
+		}
+		*len += n * dec->unitsize;
+		count -= n;
+		if (*len + dec->unitsize > chunksize) {
+			send_logic(sdi, cb, buf, *len, dec->unitsize);
+			*len = 0;
+		}
+	}
+}
+
+/* Send what part of a run of samples falls in the window [start, end). */
+static void send_window(struct decoder *dec, const struct sr_dev_inst *sdi,
+		sr_datafeed_callback_t cb, uint8_t *buf, uint64_t *len,
+		uint64_t chunksize, const uint8_t *sample, uint64_t from,
+		uint64_t to, uint64_t start, uint64_t end)
+{
+	from = MAX(from, start);
+	if (end)
+		to = MIN(to, end);
+	if (to > from)
+		send_run(dec, sdi, cb, buf, len, chunksize, sample, to - from);
+}
+
+/**
+ * Stream a transitions file into a datafeed callback, expanding it back
+ * into samples.
+ *
+ * @param filename The file to load.
+ * @param sdi The device instance, as created by transitions_dev_new().
+ * @param samplerate The samplerate to report, or 0 to use the one in
+ *                   the file.
+ * @param chunksize Maximum size of each SR_DF_LOGIC packet, in bytes.
+ * @param idx The file's index, to skip straight to the first sample. May
+ *            be NULL, in which case the file is read from the start.
+ * @param start The first sample to send.
+ * @param end The sample to stop at, 0 to send all the rest.
+ * @param cb The datafeed callback to send packets to.
+ *
+ * @return SR_OK upon success, or an SR_ERR* code upon errors.
+ */
+int transitions_run(const char *filename, const struct sr_dev_inst *sdi,
+		uint64_t samplerate, uint64_t chunksize,
+		const struct sample_index *idx, uint64_t start, uint64_t end,
+		sr_datafeed_callback_t cb)
+{
+	struct decoder dec;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_header header;
+	struct sr_datafeed_meta_logic meta;
+	const struct index_point *pt;
+	uint8_t *buf, cur[TRANSITIONS_MAX_UNITSIZE];
+	uint64_t len, pos, n, total;
+	int ret;
+
+	if (idx && start && start >= idx->num_samples) {
+		g_critical("Start is past the end of the file.");
+		return SR_ERR_ARG;
+	}
+	if (decoder_open(&dec, filename) != SR_OK) {
+		decoder_close(&dec);
+		return SR_ERR;
+	}
+	chunksize = MAX(chunksize - chunksize % dec.unitsize,
+			(uint64_t)dec.unitsize);
+	if (!(buf = g_try_malloc(chunksize))) {
+		g_critical("Input buffer malloc failed.");
+		decoder_close(&dec);
+		return SR_ERR_MALLOC;
+	}
+
+	/* Each sample holds until the next change, or the end. */
+	memcpy(cur, dec.first, dec.unitsize);
+	pos = 0;
+	if (idx && (pt = sample_index_find(idx, start))) {
+		if (fseeko(dec.fp, pt->offset, SEEK_SET) != 0) {
+			g_critical("Failed to seek in %s: %s.", filename,
+					strerror(errno));
+			g_free(buf);
+			decoder_close(&dec);
+			return SR_ERR;
+		}
+		memcpy(cur, pt->value, dec.unitsize);
+		pos = pt->sample;
+	}
+
+	packet.type = SR_DF_HEADER;
+	packet.payload = &header;
+	header.feed_version = 1;
+	gettimeofday(&header.starttime, NULL);
+	cb(sdi, &packet);
+
+	packet.type = SR_DF_META_LOGIC;
+	packet.payload = &meta;
+	meta.num_probes = dec.num_probes;
+	meta.samplerate = samplerate ? samplerate : dec.samplerate;
+	cb(sdi, &packet);
+
+	len = 0;
+	while ((ret = get_varint(&dec, &n)) == SR_OK && n) {
+		send_window(&dec, sdi, cb, buf, &len, chunksize, cur, pos,
+				pos + n, start, end);
+		pos += n;
+		if ((end && pos >= end)
+				|| (ret = get_bytes(&dec, cur, dec.unitsize))
+				!= SR_OK)
+			break;
+	}
+	/* The last sample holds until the end, if that's in the window. */
+	if (ret == SR_OK && !n && (ret = get_varint(&dec, &total)) == SR_OK) {
+		if (total < pos) {
+			g_critical("%s: invalid sample count.", filename);
+			ret = SR_ERR;
+		} else {
+			send_window(&dec, sdi, cb, buf, &len, chunksize, cur,
+					pos, total, start, end);
+		}
+	}
+	if (len)
+		send_logic(sdi, cb, buf, len, dec.unitsize);
+
+	packet.type = SR_DF_END;
+	packet.payload = NULL;
+	cb(sdi, &packet);
+
+	g_free(buf);
+	decoder_close(&dec);
+
+	return ret;
+}
@@ -0,0 +1,380 @@
+/*
+ * This file is part of the sigrok project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <inttypes.h>
+#include <glib.h>
+#include <libsigrok/libsigrok.h>
+#include "sigrok-cli.h"
+
+/*
+ * Output is written from a separate thread, so that a slow disk or a
+ * stalled pipe doesn't hold up the session loop (and with it the device's
+ * transfers). The datafeed callback copies output into one of a fixed
+ * number of buffers, and hands full buffers over to the writer thread.
+ *
+ * With a flush interval, the writer thread also wakes up once the interval
+ * has passed without output going out, and takes whatever is in the buffer
+ * being filled. That way output doesn't sit in a half-full buffer while
+ * the device is quiet.
+ */
+#define WRITER_BUFSIZE (256 * 1024)
+#define WRITER_NUMBUFS 8
+
+struct writer_buf {
+	uint8_t *data;
+	gsize len;
+	/* Where in the file it goes, or -1 to follow on from the last one. */
+	int64_t offset;
+};
+
+struct writer {
+	FILE *fp;
+	GThread *thread;
+	/* Empty buffers, ready to be filled. */
+	GAsyncQueue *free_bufs;
+	/* Filled buffers, waiting to be written out. */
+	GAsyncQueue *full_bufs;
+	struct writer_buf bufs[WRITER_NUMBUFS];
+	/* The buffer currently being filled, or NULL. Under mutex. */
+	struct writer_buf *cur;
+	/* Where the next buffer goes, from writer_seek(). Under mutex. */
+	int64_t offset;
+	/* Buffers handed to the writer thread and not yet returned. */
+	int pending;
+	GMutex mutex;
+	GCond cond;
+	gint failed;
+	/* In us, or 0 to only flush when asked to. */
+	gint64 flush_interval;
+	/* When the writer thread last flushed. */
+	gint64 flush_last;
+	/* Statistics, only touched by the producer. */
+	uint64_t bytes;
+	int high_water;
+	int stalls;
+	gint64 stall_time;
+};
+
+/* Tells the writer thread to exit. */
+static struct writer_buf stop_marker;
+
+/*
+ * Hand the current buffer over to the writer thread. The caller holds the
+ * mutex, so buffers are queued in the order they were filled in, whichever
+ * thread queues them.
+ */
+static void writer_queue(struct writer *w)
+{
+	w->pending++;
+	g_async_queue_push(w->full_bufs, w->cur);
+	w->cur = NULL;
+}
+
+/* The flush interval is up: take the partly filled buffer, if any. */
+static void writer_timeout(struct writer *w)
+{
+	g_mutex_lock(&w->mutex);
+	if (w->cur && w->cur->len)
+		writer_queue(w);
+	else
+		w->flush_last = g_get_monotonic_time();
+	g_mutex_unlock(&w->mutex);
+}
+
+/* Wait for the next buffer, or NULL if the flush interval is up first. */
+static struct writer_buf *writer_next(struct writer *w)
+{
+	gint64 timeout;
+
+	if (!w->flush_interval)
+		return g_async_queue_pop(w->full_bufs);
+
+	timeout = w->flush_last + w->flush_interval - g_get_monotonic_time();
+
+	return g_async_queue_timeout_pop(w->full_bufs, MAX(timeout, 0));
+}
+
+static gpointer writer_thread(gpointer data)
+{
+	struct writer *w;
+	struct writer_buf *buf;
+	gint64 t;
+
+	w = data;
+	w->flush_last = g_get_monotonic_time();
+	for (;;) {
+		if (!(buf = writer_next(w))) {
+			writer_timeout(w);
+			continue;
+		}
+		if (buf == &stop_marker)
+			break;
+		t = stats_start();
+		if (!g_atomic_int_get(&w->failed) && buf->offset >= 0
+				&& fseeko(w->fp, buf->offset, SEEK_SET) != 0) {
+			g_critical("Failed to seek in output: %s.",
+					strerror(errno));
+			g_atomic_int_set(&w->failed, TRUE);
+		}
+		if (!g_atomic_int_get(&w->failed)
+				&& fwrite(buf->data, 1, buf->len, w->fp) != buf->len) {
+			g_critical("Failed to write output.");
+			g_atomic_int_set(&w->failed, TRUE);
+		}
+		stats_stop(STATS_FWRITE, t);
+		buf->len = 0;
+		buf->offset = -1;
+
+		/* Only flush once there's nothing more queued up. */
+		if (g_async_queue_length(w->full_bufs) <= 0) {
+			fflush(w->fp);
+			w->flush_last = g_get_monotonic_time();
+		}
+
+		g_async_queue_push(w->free_bufs, buf);
+		g_mutex_lock(&w->mutex);
+		w->pending--;
+		g_cond_signal(&w->cond);
+		g_mutex_unlock(&w->mutex);
+	}
+
+	return NULL;
+}
+
+/**
+ * Create an output writer with its own thread.
+ *
+ * @param fp The file to write to. It stays owned by the caller, and must
+ *           not be written to directly until the writer is destroyed.
+ * @param flush_interval If not 0, output is written out at the latest
+ *                       this many ms after it was queued.
+ *
+ * @return A new writer, or NULL upon error.
+ */
+struct writer *writer_new(FILE *fp, uint64_t flush_interval)
+{
+	struct writer *w;
+	GError *error;
+	int i;
+
+	if (!(w = g_try_malloc0(sizeof(struct writer)))) {
+		g_critical("Output writer malloc failed.");
+		return NULL;
+	}
+	w->fp = fp;
+	w->flush_interval = flush_interval * 1000;
+	w->offset = -1;
+	g_mutex_init(&w->mutex);
+	g_cond_init(&w->cond);
+	w->free_bufs = g_async_queue_new();
+	w->full_bufs = g_async_queue_new();
+	for (i = 0; i < WRITER_NUMBUFS; i++) {
+		if (!(w->bufs[i].data = g_try_malloc(WRITER_BUFSIZE))) {
+			g_critical("Output writer buffer malloc failed.");
+			goto err;
+		}
+		w->bufs[i].offset = -1;
+		g_async_queue_push(w->free_bufs, &w->bufs[i]);
+	}
+
+	error = NULL;
+	if (!(w->thread = g_thread_try_new("writer", writer_thread, w,
+			&error))) {
+		g_critical("Failed to start output writer: %s.",
+				error->message);
+		g_error_free(error);
+		goto err;
+	}
+
+	return w;
+
+err:
+	for (i = 0; i < WRITER_NUMBUFS; i++)
+		g_free(w->bufs[i].data);
+	g_async_queue_unref(w->free_bufs);
+	g_async_queue_unref(w->full_bufs);
+	g_mutex_clear(&w->mutex);
+	g_cond_clear(&w->cond);
+	g_free(w);
+
+	return NULL;
+}
+
+/**
+ * Queue data for writing.
+ *
+ * This only blocks if all buffers are waiting to be written out.
+ *
+ * @param w The writer.
+ * @param data The data to write.
+ * @param len Length of the data, in bytes.
+ *
+ * @return SR_OK upon success, SR_ERR if writing the output has failed.
+ */
+int writer_write(struct writer *w, const void *data, gsize len)
+{
+	struct writer_buf *buf;
+	const uint8_t *p;
+	gint64 start;
+	gsize n;
+	int queued;
+
+	if (g_atomic_int_get(&w->failed))
+		return SR_ERR;
+
+	p = data;
+	while (len > 0) {
+		g_mutex_lock(&w->mutex);
+		if (!w->cur && !(w->cur = g_async_queue_try_pop(w->free_bufs))) {
+			/* The writer thread can't keep up. */
+			g_mutex_unlock(&w->mutex);
+			start = g_get_monotonic_time();
+			buf = g_async_queue_pop(w->free_bufs);
+			w->stall_time += g_get_monotonic_time() - start;
+			w->stalls++;
+			/* Only this thread ever sets cur. */
+			g_mutex_lock(&w->mutex);
+			w->cur = buf;
+		}
+		if (w->offset >= 0) {
+			w->cur->offset = w->offset;
+			w->offset = -1;
+		}
+		n = MIN(len, WRITER_BUFSIZE - w->cur->len);
+		memcpy(w->cur->data + w->cur->len, p, n);
+		w->cur->len += n;
+		w->bytes += n;
+		p += n;
+		len -= n;
+		if (w->cur->len == WRITER_BUFSIZE)
+			writer_queue(w);
+		g_mutex_unlock(&w->mutex);
+	}
+
+	queued = g_async_queue_length(w->full_bufs);
+	if (queued > w->high_water)
+		w->high_water = queued;
+
+	return SR_OK;
+}
+
+/**
+ * Have the data written from now on go to a different place in the file.
+ *
+ * Data already queued is still written where it would have been, and
+ * everything is written in the order it was queued in.
+ *
+ * @param w The writer.
+ * @param offset Where the next data goes, from the start of the file.
+ */
+void writer_seek(struct writer *w, uint64_t offset)
+{
+	g_mutex_lock(&w->mutex);
+	if (w->cur && w->cur->len)
+		writer_queue(w);
+	if (w->cur)
+		w->cur->offset = offset;
+	else
+		w->offset = offset;
+	g_mutex_unlock(&w->mutex);
+}
+
+/**
+ * Pass everything queued so far on to the writer thread, without waiting.
+ *
+ * If the writer thread is still busy with all other buffers, the data
+ * stays in the current buffer and goes out with the next one instead.
+ *
+ * @param w The writer.
+ */
+void writer_flush(struct writer *w)
+{
+	struct writer_buf *next;
+
+	g_mutex_lock(&w->mutex);
+	if (w->cur && w->cur->len
+			&& (next = g_async_queue_try_pop(w->free_bufs))) {
+		writer_queue(w);
+		w->cur = next;
+	}
+	g_mutex_unlock(&w->mutex);
+}
+
+/**
+ * Write out everything queued so far, and wait until it's done.
+ *
+ * @param w The writer.
+ *
+ * @return SR_OK upon success, SR_ERR if writing the output has failed.
+ */
+int writer_sync(struct writer *w)
+{
+	g_mutex_lock(&w->mutex);
+	if (w->cur && w->cur->len)
+		writer_queue(w);
+	while (w->pending > 0)
+		g_cond_wait(&w->cond, &w->mutex);
+	g_mutex_unlock(&w->mutex);
+	if (fflush(w->fp) != 0 && !g_atomic_int_get(&w->failed)) {
+		g_critical("Failed to write output: %s.", strerror(errno));
+		g_atomic_int_set(&w->failed, TRUE);
+	}
+
+	return g_atomic_int_get(&w->failed) ? SR_ERR : SR_OK;
+}
+
+/**
+ * Write out everything queued, stop the writer thread and free the writer.
+ *
+ * The file itself is not closed.
+ *
+ * @param w The writer.
+ */
+void writer_destroy(struct writer *w)
+{
+	int i;
+
+	if (!w)
+		return;
+
+	writer_sync(w);
+	g_async_queue_push(w->full_bufs, &stop_marker);
+	g_thread_join(w->thread);
+
+	g_message("cli: Wrote %" PRIu64 " bytes of output, queue high-water "
+			"mark %d/%d buffers.", w->bytes, w->high_water,
+			WRITER_NUMBUFS);
+	if (w->stalls)
+		g_message("cli: Output writer stalled %d times, for %"
+				PRId64 " ms in total.", w->stalls,
+				w->stall_time / 1000);
+
+	for (i = 0; i < WRITER_NUMBUFS; i++)
+		g_free(w->bufs[i].data);
+	g_async_queue_unref(w->free_bufs);
+	g_async_queue_unref(w->full_bufs);
+	g_mutex_clear(&w->mutex);
+	g_cond_clear(&w->cond);
+	g_free(w);
+}